@@ -14,6 +14,9 @@
 
 #include <cassert>
 
+#include "pipes_control.hpp"
+#include "pipes_shared_path.hpp"
+#include "pipes_trace.hpp"
 #include "pipes_types.hpp"
 
 using namespace std;
@@ -28,12 +31,18 @@ namespace pipes {
 // with an assertion.
 //
 // The grid must be non-empty.
-path econ_pipes_exhaustive(const grid& setting) {
+//
+// If control is not null, the search checks in every few thousand bit
+// patterns, and returns the best path so far when told to stop.
+path econ_pipes_exhaustive(const grid& setting,
+                           solve_control* control = nullptr) {
 
   // grid must be non-empty.
   assert(setting.rows() > 0);
   assert(setting.columns() > 0);
 
+  trace_scope trace("exhaustive: search");
+
   // Compute the path length, and check that it is legal.
   const size_t total_steps = setting.rows() + setting.columns() - 2;
   assert(total_steps < 64);
@@ -55,8 +64,17 @@ path econ_pipes_exhaustive(const grid& setting) {
 
   // compute each candidate and compare it with best
   //3. for bits from 0 to (2^maxlen - 1) inclusive
-  for (int bits = 0; bits <= ((int)pow(2,maxlen) - 1); ++bits)
+  const int last_bits = (int)pow(2,maxlen) - 1;
+  for (int bits = 0; bits <= last_bits; ++bits)
 	{//for bits
+	//check in with the caller every 4096 bit patterns
+	if (control && ((bits & 0xFFF) == 0) &&
+	    !control->check_in(double(bits) / (double(last_bits) + 1),
+	                       best_still_empty ? 0 : best.total_open()))
+		{//if stopped
+		break;
+		}//if stopped
+
 	//4. candidate = [start]
 	path candidate(setting);
 
@@ -112,13 +130,20 @@ path econ_pipes_exhaustive(const grid& setting) {
 // programming algorithm.
 //
 // The grid must be non-empty.
-path econ_pipes_dyn_prog(const grid& setting) {
+//
+// If control is not null, the fill checks in once per row, and returns the
+// best path among the rows filled so far when told to stop.
+path econ_pipes_dyn_prog(const grid& setting,
+                         solve_control* control = nullptr) {
 
   // grid must be non-empty.
   assert(setting.rows() > 0);
   assert(setting.columns() > 0);
 
-  using cell_type = std::optional<path>;
+  // cells share their prefixes, so extending a neighbour's path is O(1)
+  using cell_type = std::optional<shared_path>;
+
+  trace_scope phase("dyn_prog: allocate");
 
   //1. A = new rxc matrix
   std::vector<std::vector<cell_type>> A(setting.rows(),
@@ -126,18 +151,27 @@ path econ_pipes_dyn_prog(const grid& setting) {
 
   //2. base case
   //3. A[0][0] = start
-  A[0][0] = path(setting);
+  A[0][0] = shared_path(setting);
   assert(A[0][0].has_value());
 
   //create from_above and from_left
-  path from_left(setting);
-  path from_above(setting);
+  shared_path from_left(setting);
+  shared_path from_above(setting);
 
+  //most open cells in any path so far, for progress reports
+  unsigned best_open = 0;
+
+  phase.next("dyn_prog: fill");
 
   //4. general cases
   //5. for i from 0 to r-1 inclusive
   for (coordinate r = 0; r < setting.rows(); ++r)
 	{//for r
+	//check in with the caller once per row
+	if (control && !control->check_in(double(r) / setting.rows(), best_open))
+		{//if stopped
+		break;
+		}//if stopped
     //cout << "r = " << r << " / " << setting.rows() << endl;
 	//6. for j from 0 to c-1 inclusive
     	for (coordinate c = 0; c < setting.columns(); ++c)
@@ -190,10 +224,16 @@ path econ_pipes_dyn_prog(const grid& setting) {
             }
 					}//if
           A[r][c] = best;
+          if(best.has_value() && best->total_open() > best_open)
+            {
+              best_open = best->total_open();
+            }
         }//else
     		}//for c
   	}//for r
 //cout << "done with loops" << endl;
+  phase.next("dyn_prog: post-process");
+
   //22. post-processing to find maximum open-cells path
   coordinate r = setting.rows()-1;
   coordinate c = setting.columns()-1;
@@ -202,22 +242,27 @@ path econ_pipes_dyn_prog(const grid& setting) {
   //assert(best->has_value());
   //check for the best path
 
-  for (coordinate i = r; i >= 0; --i)
+  // scan backwards from the bottom-right, keeping the first path with the
+  // most open cells (ties go to the cell closest to the bottom-right)
+  cell_type * best = nullptr;
+  for (coordinate i = r + 1; i-- > 0; )
     {
-      for(coordinate j = c; j >= 0; --j)
+      for(coordinate j = c + 1; j-- > 0; )
         {
           //check for valid
-          if(A[i][j].has_value())
+          if(A[i][j].has_value() &&
+             ((best == nullptr) ||
+              (A[i][j]->total_open() > (*best)->total_open())))
             {
-              cell_type * best = &(A[i][j]);
-              assert(best->has_value());
-              return **best;
+              best = &(A[i][j]);
             }//if
         }//for
     }//for
 
   //24. return best
-  //return **best;
+  assert(best != nullptr);
+  phase.next("dyn_prog: reconstruct path");
+  return (*best)->to_path();
 }//function
   
 }
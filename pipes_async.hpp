@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_async.hpp
+//
+// Run an economical pipes solver on a background thread, with a handle that
+// can wait for, cancel, or poll the solve.
+//
+// Usage:
+//
+//    pipes::solve_options options;
+//    options.deadline = std::chrono::steady_clock::now() +
+//                       std::chrono::milliseconds(50);
+//    auto handle = pipes::solve_async(setting, pipes::econ_pipes_dyn_prog,
+//                                     options);
+//    ...
+//    auto result = handle.get();
+//    if (result.status == pipes::SOLVE_COMPLETE) { ... result.best ... }
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <future>
+#include <memory>
+#include <utility>
+
+#include "pipes_control.hpp"
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// Output of an asynchronous solve. setting owns the copy of the grid that
+// best refers to, so the result stays valid after the caller's grid is gone.
+// When status is not SOLVE_COMPLETE, best is the best path the solver found
+// before it stopped.
+struct solve_result {
+  solve_status status;
+  std::shared_ptr<const grid> setting;
+  path best;
+};
+
+// Handle to a solve running on another thread. Destroying the handle waits
+// for the solve to finish, so cancel() first to abandon it quickly.
+class solve_handle {
+private:
+  std::shared_ptr<solve_control> control_;
+  std::future<solve_result> future_;
+
+public:
+
+  solve_handle(std::shared_ptr<solve_control> control,
+               std::future<solve_result> future)
+  : control_(std::move(control)), future_(std::move(future)) { }
+
+  // Ask the solver to stop at its next check-in.
+  void cancel() { control_->cancel(); }
+
+  // Return SOLVE_RUNNING while the solver is still working.
+  solve_status status() const { return control_->status(); }
+
+  // Return true if get() would not block.
+  bool ready() const {
+    return future_.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+
+  // Block until the solve finishes.
+  void wait() const { future_.wait(); }
+
+  // Block until the solve finishes or the timeout passes. Returns true if
+  // the solve finished.
+  template <typename Rep, typename Period>
+  bool wait_for(const std::chrono::duration<Rep, Period>& timeout) const {
+    return future_.wait_for(timeout) == std::future_status::ready;
+  }
+
+  // Block until the solve finishes and return its result. May only be
+  // called once.
+  solve_result get() { return future_.get(); }
+};
+
+// Start solving a copy of setting on a new thread. solver is called as
+// solver(grid, solve_control*), like econ_pipes_exhaustive and
+// econ_pipes_dyn_prog, and must check in with the control to be cancellable.
+template <typename Solver>
+solve_handle solve_async(const grid& setting, Solver solver,
+                         const solve_options& options = solve_options()) {
+
+  auto control = std::make_shared<solve_control>(options);
+  auto copy = std::make_shared<const grid>(setting);
+
+  auto future = std::async(std::launch::async,
+                           [control, copy, solver]() {
+    trace_scope trace("async: solve task");
+    path best = solver(*copy, control.get());
+    control->finish();
+    return solve_result{control->status(), copy, std::move(best)};
+  });
+
+  return solve_handle(std::move(control), std::move(future));
+}
+
+}
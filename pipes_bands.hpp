@@ -0,0 +1,459 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_bands.hpp
+//
+// A dynamic programming solver that splits the grid into horizontal bands
+// and solves each band in its own worker process.
+//
+// The bands form a pipeline over blocks of columns. A band fills the cells
+// of one block, row by row, as soon as it has the scores of the row just
+// above it in that block, which the band above sends once it has filled the
+// same block. Meanwhile the band above moves on to the next block, so after
+// the first few blocks every band is busy. Each band sends the scores of
+// its bottom row once, so the traffic per band is linear in the number of
+// columns, and all bands together do the same O(rows * columns) work as the
+// sequential DP. The path is then traced back band by band.
+//
+// Workers are forked, so they share the grid copy-on-write. Each talks to
+// the next band's worker, and to the parent, over pipes. This is POSIX-only.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "pipes_io.hpp"
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// Settings for the band solver.
+struct band_options {
+
+  // Number of bands to split the rows into. Clamped to the number of rows.
+  size_t bands = 4;
+
+  // Columns per block of the pipeline. 0 picks a size that gives every band
+  // several blocks to work on.
+  coordinate block_columns = 0;
+
+  // When false, the bands are solved one after another in this process,
+  // which gives the same result without forking.
+  bool use_processes = true;
+};
+
+namespace band_detail {
+
+// Best cell within one band: the highest score, and among equal scores the
+// last cell in row-major order. score is -1 when no cell is reachable.
+struct band_best {
+  int32_t score;
+  uint64_t row, column;
+};
+
+// The DP for one band of rows, [first_row, end_row). Scores are open cell
+// counts, with -1 meaning unreachable, as in econ_pipes_endpoints.
+class band_worker {
+private:
+  const grid* setting_;
+  coordinate first_row_, end_row_, columns_;
+  // For each cell in the band, whether the best path arrives from the left.
+  std::vector<uint8_t> from_left_;
+
+  int32_t open(coordinate row, coordinate column) const {
+    return (setting_->get(row, column) == CELL_OPEN) ? 1 : 0;
+  }
+
+public:
+
+  band_worker(const grid& setting, coordinate first_row, coordinate end_row)
+  : setting_(&setting),
+    first_row_(first_row),
+    end_row_(end_row),
+    columns_(setting.columns()) {
+
+    assert(first_row < end_row);
+    assert(end_row <= setting.rows());
+  }
+
+  // Fill in the band's DP table one block of columns at a time, from left
+  // to right, and return the band's best cell.
+  //
+  // For each block, take(first, count, scores) must store the scores of the
+  // row just above the band in columns [first, first + count), and
+  // give(first, count, scores) is then passed the band's bottom row in the
+  // same columns. The first band makes up the row above (0, 0) itself,
+  // without calling take.
+  template <typename Take, typename Give>
+  band_best fill(coordinate block, Take&& take, Give&& give) {
+    assert(block > 0);
+
+    const coordinate height = end_row_ - first_row_;
+    from_left_.assign(height * columns_, 0);
+
+    // Scores of the row last filled, in the current block; the score of
+    // each row just left of the block; and the best cell of each row.
+    std::vector<int32_t> row(block);
+    std::vector<int32_t> left(height, -1);
+    std::vector<band_best> row_best(height, band_best{-1, 0, 0});
+
+    for (coordinate first = 0; first < columns_; first += block) {
+      const coordinate count = std::min(block, columns_ - first);
+      if (first_row_ == 0) {
+        std::fill(row.begin(), row.begin() + count, -1);
+        if (first == 0) {
+          row[0] = 0;
+        }
+      } else {
+        take(first, count, row.data());
+      }
+
+      for (coordinate r = first_row_; r < end_row_; ++r) {
+        const coordinate i = r - first_row_;
+        uint8_t* bits = &from_left_[i * columns_ + first];
+        int32_t here = left[i];
+        band_best& best = row_best[i];
+        for (coordinate j = 0; j < count; ++j) {
+          const coordinate c = first + j;
+          if (setting_->get(r, c) == CELL_ROCK) {
+            row[j] = here = -1;
+            continue;
+          }
+          // Prefer arriving from above, as econ_pipes_dyn_prog does.
+          int32_t score = row[j];
+          if (here > score) {
+            score = here;
+            bits[j] = 1;
+          }
+          row[j] = here = (score < 0) ? -1 : score + open(r, c);
+          if ((here >= 0) && (here >= best.score)) {
+            best = band_best{here, r, c};
+          }
+        }
+        left[i] = here;
+      }
+
+      give(first, count, row.data());
+    }
+
+    // Keep the last best cell in row-major order.
+    band_best best{-1, 0, 0};
+    for (auto& candidate : row_best) {
+      if ((candidate.score >= 0) && (candidate.score >= best.score)) {
+        best = candidate;
+      }
+    }
+    return best;
+  }
+
+  // Trace the best path back from a cell in this band, after fill(),
+  // appending its steps to reversed in reverse order. Returns the column
+  // the path leaves the band through its top row, or columns() if it
+  // reaches (0, 0) instead.
+  coordinate trace(coordinate row, coordinate column,
+                   std::vector<step_direction>& reversed) const {
+    assert((row >= first_row_) && (row < end_row_));
+    while (!((row == 0) && (column == 0))) {
+      if (from_left_[(row - first_row_) * columns_ + column]) {
+        reversed.push_back(STEP_DIRECTION_RIGHT);
+        --column;
+      } else {
+        reversed.push_back(STEP_DIRECTION_DOWN);
+        if (row == first_row_) {
+          return column;
+        }
+        --row;
+      }
+    }
+    return columns_;
+  }
+};
+
+// Sent to a worker process in place of a row to make it exit.
+const uint64_t QUIT = ~uint64_t(0);
+
+// File descriptors that are closed when this goes out of scope.
+struct closing_fds {
+  std::vector<int> fds;
+
+  closing_fds() = default;
+  closing_fds(const closing_fds&) = delete;
+  closing_fds& operator=(const closing_fds&) = delete;
+
+  ~closing_fds() {
+    close_all();
+  }
+
+  void close_all() {
+    for (int fd : fds) {
+      ::close(fd);
+    }
+    fds.clear();
+  }
+};
+
+// The parent's view of one band, either solved in this process or in a
+// forked child that runs the same band_worker behind a pipe protocol:
+//
+//   above -> child    scores above the band, one block at a time
+//   child -> below    scores along the band's bottom row, likewise
+//   child -> parent   band_best
+//   then repeatedly:
+//   parent -> child   row, column to trace from, or QUIT
+//   child -> parent   step count, steps, exit column
+//
+// where above is the previous band's child and below the next one's.
+class band_channel {
+private:
+  band_worker worker_;
+  coordinate columns_;
+  pid_t pid_ = -1;
+  int to_child_ = -1, from_child_ = -1;
+  // Result of the in-process fill, or the one read from the child.
+  band_best best_{-1, 0, 0};
+  bool have_best_ = false;
+
+  // Body of the child process. above and below are -1 for the first and
+  // last bands.
+  [[noreturn]] void serve(int in, int out, int above, int below,
+                          coordinate block) {
+    int status = 0;
+    try {
+      auto best = worker_.fill(
+        block,
+        [&](coordinate, coordinate count, int32_t* scores) {
+          read_all(above, scores, count * sizeof(int32_t));
+        },
+        [&](coordinate, coordinate count, const int32_t* scores) {
+          if (below >= 0) {
+            write_all(below, scores, count * sizeof(int32_t));
+          }
+        });
+      write_all(out, &best, sizeof(best));
+
+      for (;;) {
+        uint64_t where[2];
+        read_all(in, &where[0], sizeof(uint64_t));
+        if (where[0] == QUIT) {
+          break;
+        }
+        read_all(in, &where[1], sizeof(uint64_t));
+        std::vector<step_direction> reversed;
+        uint64_t exit = worker_.trace(where[0], where[1], reversed);
+        uint64_t count = reversed.size();
+        std::vector<uint8_t> packed(reversed.begin(), reversed.end());
+        write_all(out, &count, sizeof(count));
+        write_all(out, packed.data(), packed.size());
+        write_all(out, &exit, sizeof(exit));
+      }
+    } catch (...) {
+      status = 1;
+    }
+    ::_exit(status);
+  }
+
+public:
+
+  band_channel(const grid& setting, coordinate first_row, coordinate end_row)
+  : worker_(setting, first_row, end_row), columns_(setting.columns()) { }
+
+  band_channel(const band_channel&) = delete;
+  band_channel& operator=(const band_channel&) = delete;
+
+  // Tell the child to quit, if there is one, and reap it.
+  ~band_channel() {
+    if (pid_ > 0) {
+      try {
+        write_all(to_child_, &QUIT, sizeof(QUIT));
+      } catch (...) {
+      }
+      ::close(to_child_);
+      ::close(from_child_);
+      int status;
+      while ((::waitpid(pid_, &status, 0) < 0) && (errno == EINTR)) {
+      }
+    }
+  }
+
+  // Fork a child process to fill this band and trace through it, reading
+  // the scores above the band from above and sending its bottom row to
+  // below, either of which may be -1. The child closes every descriptor in
+  // links other than those two. Without this, fill_here() must be called.
+  void start(int above, int below, const std::vector<int>& links,
+             coordinate block) {
+    int down[2], up[2];
+    if (::pipe(down) < 0) {
+      throw std::system_error(errno, std::generic_category(), "pipe");
+    }
+    if (::pipe(up) < 0) {
+      int saved = errno;
+      ::close(down[0]);
+      ::close(down[1]);
+      throw std::system_error(saved, std::generic_category(), "pipe");
+    }
+    pid_t pid = ::fork();
+    if (pid < 0) {
+      int saved = errno;
+      for (int fd : {down[0], down[1], up[0], up[1]}) {
+        ::close(fd);
+      }
+      throw std::system_error(saved, std::generic_category(), "fork");
+    }
+    if (pid == 0) {
+      ::close(down[1]);
+      ::close(up[0]);
+      for (int fd : links) {
+        if ((fd != above) && (fd != below)) {
+          ::close(fd);
+        }
+      }
+      serve(down[0], up[1], above, below, block);
+    }
+    ::close(down[0]);
+    ::close(up[1]);
+    pid_ = pid;
+    to_child_ = down[1];
+    from_child_ = up[0];
+  }
+
+  // Fill the band in this process. boundary holds the scores of the row
+  // above the band on entry, and those of its bottom row on return.
+  void fill_here(std::vector<int32_t>& boundary, coordinate block) {
+    assert(pid_ < 0);
+    assert(boundary.size() == columns_);
+    best_ = worker_.fill(
+      block,
+      [&](coordinate first, coordinate count, int32_t* scores) {
+        std::copy(&boundary[first], &boundary[first] + count, scores);
+      },
+      [&](coordinate first, coordinate count, const int32_t* scores) {
+        std::copy(scores, scores + count, &boundary[first]);
+      });
+    have_best_ = true;
+  }
+
+  band_best best() {
+    if (!have_best_) {
+      assert(pid_ > 0);
+      read_all(from_child_, &best_, sizeof(best_));
+      have_best_ = true;
+    }
+    return best_;
+  }
+
+  coordinate trace(coordinate row, coordinate column,
+                   std::vector<step_direction>& reversed) {
+    if (pid_ < 0) {
+      return worker_.trace(row, column, reversed);
+    }
+    uint64_t where[2] = {row, column};
+    write_all(to_child_, where, sizeof(where));
+    uint64_t count, exit;
+    read_all(from_child_, &count, sizeof(count));
+    std::vector<uint8_t> packed(count);
+    read_all(from_child_, packed.data(), packed.size());
+    read_all(from_child_, &exit, sizeof(exit));
+    for (auto s : packed) {
+      reversed.push_back(step_direction(s));
+    }
+    return exit;
+  }
+};
+
+}
+
+// Solve the economical pipes problem by splitting the grid into bands.
+//
+// The result is identical to econ_pipes_dyn_prog, including how ties are
+// broken. Each band of h rows and c columns takes O(h * c) time and memory,
+// and the bands run in parallel when use_processes is set, apart from the
+// first and last few blocks of the pipeline.
+path econ_pipes_bands(const grid& setting,
+                      const band_options& options = band_options()) {
+
+  using namespace band_detail;
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  const size_t bands = std::max<size_t>(1, std::min<size_t>(options.bands,
+                                                             rows));
+  const coordinate block =
+    (options.block_columns > 0)
+      ? options.block_columns
+      : std::min<coordinate>(4096, std::max<coordinate>(
+                                     64, columns / (4 * bands)));
+
+  trace_scope phase("bands: start workers");
+
+  std::vector<std::unique_ptr<band_channel>> channels;
+  for (size_t k = 0; k < bands; ++k) {
+    channels.push_back(std::make_unique<band_channel>(
+      setting, rows * k / bands, rows * (k + 1) / bands));
+  }
+
+  phase.next("bands: fill");
+
+  if (options.use_processes) {
+    // links.fds[2 * k] reads what band k writes to links.fds[2 * k + 1].
+    closing_fds links;
+    for (size_t k = 0; k + 1 < bands; ++k) {
+      int ends[2];
+      if (::pipe(ends) < 0) {
+        throw std::system_error(errno, std::generic_category(), "pipe");
+      }
+      links.fds.push_back(ends[0]);
+      links.fds.push_back(ends[1]);
+    }
+    for (size_t k = 0; k < bands; ++k) {
+      channels[k]->start((k > 0) ? links.fds[2 * (k - 1)] : -1,
+                         (k + 1 < bands) ? links.fds[2 * k + 1] : -1,
+                         links.fds, block);
+    }
+  } else {
+    std::vector<int32_t> boundary(columns);
+    for (auto& channel : channels) {
+      channel->fill_here(boundary, block);
+    }
+  }
+
+  // Keep the last best cell in row-major order, as econ_pipes_dyn_prog does.
+  size_t best_band = 0;
+  band_best best{-1, 0, 0};
+  for (size_t k = 0; k < bands; ++k) {
+    auto candidate = channels[k]->best();
+    if ((candidate.score >= 0) && (candidate.score >= best.score)) {
+      best = candidate;
+      best_band = k;
+    }
+  }
+  assert(best.score >= 0);
+
+  phase.next("bands: reconstruct path");
+
+  std::vector<step_direction> reversed;
+  coordinate row = best.row, column = best.column;
+  for (size_t k = best_band + 1; k-- > 0; ) {
+    coordinate exit = channels[k]->trace(row, column, reversed);
+    if (exit == columns) {
+      break;
+    }
+    assert(k > 0);
+    row = rows * k / bands - 1;
+    column = exit;
+  }
+
+  return path(setting,
+              std::vector<step_direction>(reversed.rbegin(), reversed.rend()));
+}
+
+}
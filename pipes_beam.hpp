@@ -0,0 +1,253 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_beam.hpp
+//
+// An anytime beam search for economical pipes, for callers that would
+// rather have a good path quickly than the best path late.
+//
+// Every path reaches anti-diagonal d (the cells with row + column == d)
+// after exactly d steps, so the search advances one anti-diagonal at a
+// time. Partial paths that end on the same cell are merged, keeping the
+// better one, and only the `width` most promising cells survive to the next
+// diagonal, ranked by open cells so far plus a short lookahead. The search
+// stops early when a node budget runs out or its solve_control says so, and
+// returns the best path seen up to then.
+//
+// When width is at least the length of the longest anti-diagonal nothing is
+// pruned, and the result is identical to econ_pipes_dyn_prog.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "pipes_control.hpp"
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// Settings for econ_pipes_beam.
+struct beam_options {
+
+  // Most cells kept per anti-diagonal.
+  size_t width = 64;
+
+  // Cells looked ahead, right and down, when ranking a partial path.
+  coordinate lookahead = 4;
+
+  // Stop after creating this many partial paths.
+  size_t max_nodes = std::numeric_limits<size_t>::max();
+};
+
+// Output of econ_pipes_beam. complete is false when the node budget or the
+// solve_control stopped the search before the last anti-diagonal.
+struct beam_result {
+  solution_steps best;
+  size_t nodes;
+  bool complete;
+};
+
+// How far an approximate path falls short of the optimum.
+struct optimality_gap {
+  unsigned found, optimal;
+
+  // Open cells missed.
+  unsigned missing() const { return optimal - found; }
+
+  // found / optimal, or 1 when the optimum has no open cells.
+  double ratio() const {
+    return (optimal == 0) ? 1.0 : double(found) / double(optimal);
+  }
+};
+
+// Compare a beam search result with an exact solution of the same grid,
+// such as the output of econ_pipes_dyn_prog.
+optimality_gap beam_gap(const beam_result& result, const path& exact) {
+  assert(result.best.total_open <= exact.total_open());
+  return optimality_gap{result.best.total_open, exact.total_open()};
+}
+
+namespace beam_detail {
+
+const uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+// A partial path, stored as its last cell and a link to the node for the
+// cell before it.
+struct node {
+  coordinate row, column;
+  uint32_t parent;
+  unsigned open;
+};
+
+// Most open cells among the next `lookahead` cells straight right or
+// straight down from (row, column), stopping at rocks and the edge.
+unsigned lookahead_open(const grid& setting, coordinate row, coordinate column,
+                        coordinate lookahead) {
+  unsigned right = 0, down = 0;
+  for (coordinate k = 1; k <= lookahead; ++k) {
+    if ((column + k >= setting.columns()) ||
+        (setting.get(row, column + k) == CELL_ROCK)) {
+      break;
+    }
+    right += (setting.get(row, column + k) == CELL_OPEN);
+  }
+  for (coordinate k = 1; k <= lookahead; ++k) {
+    if ((row + k >= setting.rows()) ||
+        (setting.get(row + k, column) == CELL_ROCK)) {
+      break;
+    }
+    down += (setting.get(row + k, column) == CELL_OPEN);
+  }
+  return std::max(right, down);
+}
+
+}
+
+// Search for a good path with a beam of options.width cells per
+// anti-diagonal.
+//
+// The grid must be non-empty, and width at least 1.
+//
+// If control is not null, the search checks in once per anti-diagonal.
+beam_result econ_pipes_beam(const grid& setting,
+                            const beam_options& options = beam_options(),
+                            solve_control* control = nullptr) {
+
+  using beam_detail::node;
+  using beam_detail::NO_PARENT;
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  assert(rows > 0);
+  assert(columns > 0);
+  assert(options.width > 0);
+
+  trace_scope phase("beam: search");
+
+  // Every node created, so that paths can be walked back.
+  std::vector<node> nodes{node{0, 0, NO_PARENT, 0}};
+
+  // Indices into nodes of the cells kept on the current diagonal, in
+  // increasing row order.
+  std::vector<uint32_t> beam{0};
+
+  // Candidates for the next diagonal, and their ranks.
+  std::vector<node> next;
+  std::vector<std::pair<unsigned, size_t>> ranked;
+
+  // Keep the last best cell in row-major order, as the DP does.
+  uint32_t best = 0;
+  bool complete = true;
+
+  const coordinate diagonals = rows + columns - 1;
+  for (coordinate d = 0; ; ++d) {
+
+    for (auto i : beam) {
+      const node& n = nodes[i];
+      const node& b = nodes[best];
+      if ((n.open > b.open) ||
+          ((n.open == b.open) &&
+           ((n.row > b.row) || ((n.row == b.row) && (n.column > b.column))))) {
+        best = i;
+      }
+    }
+
+    if (d + 1 == diagonals) {
+      break;
+    }
+    if ((nodes.size() >= options.max_nodes) ||
+        (control && !control->check_in(double(d) / diagonals,
+                                        nodes[best].open))) {
+      complete = false;
+      break;
+    }
+
+    // Extend every kept cell right and down. Since the beam is in row
+    // order, two paths reaching the same cell are adjacent: first the one
+    // arriving from above, then the one from the left, which wins only if
+    // strictly better.
+    next.clear();
+    for (auto i : beam) {
+      const node& n = nodes[i];
+      if ((n.column + 1 < columns) &&
+          (setting.get(n.row, n.column + 1) != CELL_ROCK)) {
+        unsigned open = n.open +
+          (setting.get(n.row, n.column + 1) == CELL_OPEN);
+        if (!next.empty() && (next.back().row == n.row)) {
+          if (open > next.back().open) {
+            next.back() = node{n.row, n.column + 1, i, open};
+          }
+        } else {
+          next.push_back(node{n.row, n.column + 1, i, open});
+        }
+      }
+      if ((n.row + 1 < rows) &&
+          (setting.get(n.row + 1, n.column) != CELL_ROCK)) {
+        unsigned open = n.open +
+          (setting.get(n.row + 1, n.column) == CELL_OPEN);
+        next.push_back(node{n.row + 1, n.column, i, open});
+      }
+    }
+    if (next.empty()) {
+      break;
+    }
+
+    // Keep the most promising cells, breaking ties toward lower rows.
+    if (next.size() > options.width) {
+      ranked.clear();
+      for (size_t k = 0; k < next.size(); ++k) {
+        ranked.emplace_back(next[k].open +
+                              beam_detail::lookahead_open(
+                                setting, next[k].row, next[k].column,
+                                options.lookahead),
+                            k);
+      }
+      std::partial_sort(ranked.begin(), ranked.begin() + options.width,
+                        ranked.end(),
+                        [](const std::pair<unsigned, size_t>& a,
+                           const std::pair<unsigned, size_t>& b) {
+                          return (a.first > b.first) ||
+                                 ((a.first == b.first) && (a.second < b.second));
+                        });
+      ranked.resize(options.width);
+      std::sort(ranked.begin(), ranked.end(),
+                [](const std::pair<unsigned, size_t>& a,
+                   const std::pair<unsigned, size_t>& b) {
+                  return a.second < b.second;
+                });
+      size_t kept = 0;
+      for (auto& r : ranked) {
+        next[kept++] = next[r.second];
+      }
+      next.resize(kept);
+    }
+
+    beam.clear();
+    for (auto& n : next) {
+      beam.push_back(uint32_t(nodes.size()));
+      nodes.push_back(n);
+    }
+  }
+
+  phase.next("beam: reconstruct path");
+
+  beam_result result;
+  result.best.final_row = nodes[best].row;
+  result.best.final_column = nodes[best].column;
+  result.best.total_open = nodes[best].open;
+  for (uint32_t i = best; nodes[i].parent != NO_PARENT; i = nodes[i].parent) {
+    result.best.steps.push_back(
+      (nodes[nodes[i].parent].row == nodes[i].row) ? STEP_DIRECTION_RIGHT
+                                                   : STEP_DIRECTION_DOWN);
+  }
+  std::reverse(result.best.steps.begin(), result.best.steps.end());
+  result.nodes = nodes.size();
+  result.complete = complete;
+  return result;
+}
+
+}
@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_bitslice.hpp
+//
+// A bit-sliced exhaustive search that walks 64 step patterns at once.
+//
+// Lane l of a batch follows bit pattern base + l, one step per bit, like
+// econ_pipes_exhaustive. All lanes stand on the same anti-diagonal after
+// each step, so a lane's position is just its row. Positions are stored as
+// one 64-bit plane per row, with bit l set when lane l is on that row, and
+// the open-cell count of every lane is a small binary counter stored one
+// plane per bit. A step, a rock test, an open-cell count and a comparison
+// against the best so far are then a few word operations per row, using
+// per-diagonal tables of which rows are rock or open. A lane dies when it
+// steps onto a rock or off the grid, and a batch ends as soon as every lane
+// is dead.
+//
+// Only the winning pattern is turned into a path, at the end.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "pipes_control.hpp"
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+namespace bitslice_detail {
+
+// Lanes in a batch.
+const unsigned LANES = 64;
+
+// LANE_BIT[k] has bit l set when bit k of l is set, for k < 6.
+const uint64_t LANE_BIT[6] = {
+  0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+  0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull
+};
+
+// Lanes whose pattern base + l has bit k set, meaning step k goes right.
+uint64_t right_lanes(uint64_t base, size_t k) {
+  if (k < 6) {
+    return LANE_BIT[k];
+  }
+  return ((base >> k) & 1) ? ~uint64_t(0) : uint64_t(0);
+}
+
+// Add one to the counter of every lane in lanes.
+void increment(std::vector<uint64_t>& counter, uint64_t lanes) {
+  for (auto& plane : counter) {
+    uint64_t carry = plane & lanes;
+    plane ^= lanes;
+    lanes = carry;
+  }
+}
+
+// Lanes whose counter is strictly greater than value.
+uint64_t greater_than(const std::vector<uint64_t>& counter, unsigned value) {
+  uint64_t greater = 0, equal = ~uint64_t(0);
+  for (size_t i = counter.size(); i-- > 0; ) {
+    if ((value >> i) & 1) {
+      equal &= counter[i];
+    } else {
+      greater |= equal & counter[i];
+      equal &= ~counter[i];
+    }
+  }
+  return greater;
+}
+
+// The counter of one lane.
+unsigned lane_value(const std::vector<uint64_t>& counter, unsigned lane) {
+  unsigned value = 0;
+  for (size_t i = 0; i < counter.size(); ++i) {
+    value |= unsigned((counter[i] >> lane) & 1) << i;
+  }
+  return value;
+}
+
+}
+
+// Solve the economical pipes problem by trying every step pattern, like
+// econ_pipes_exhaustive, 64 patterns at a time.
+//
+// The result has the same number of open cells as econ_pipes_exhaustive,
+// but when several paths tie, the one returned may differ.
+//
+// The grid must be non-empty, and rows + columns - 2 must be less than 64.
+//
+// If control is not null, the search checks in every few thousand batches,
+// and returns the best path so far when told to stop.
+path econ_pipes_bitsliced(const grid& setting,
+                          solve_control* control = nullptr) {
+
+  using namespace bitslice_detail;
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  assert(rows > 0);
+  assert(columns > 0);
+
+  const size_t total_steps = rows + columns - 2;
+  assert(total_steps < 64);
+
+  trace_scope phase("bitsliced: tables");
+
+  // blocked[d][r] and open[d][r] describe cell (r, d - r) on anti-diagonal
+  // d, with cells off the grid counted as blocked.
+  std::vector<std::vector<uint8_t>> blocked(total_steps + 1,
+                                            std::vector<uint8_t>(rows, 1)),
+                                    open(total_steps + 1,
+                                         std::vector<uint8_t>(rows, 0));
+  for (coordinate r = 0; r < rows; ++r) {
+    for (coordinate c = 0; c < columns; ++c) {
+      blocked[r + c][r] = (setting.get(r, c) == CELL_ROCK);
+      open[r + c][r] = (setting.get(r, c) == CELL_OPEN);
+    }
+  }
+
+  unsigned counter_bits = 1;
+  while ((size_t(1) << counter_bits) <= total_steps) {
+    ++counter_bits;
+  }
+
+  phase.next("bitsliced: search");
+
+  std::vector<uint64_t> planes(rows), counter(counter_bits);
+
+  // The best pattern, how many of its steps to take, and its open cells.
+  uint64_t best_pattern = 0;
+  size_t best_steps = 0;
+  unsigned best_open = 0;
+
+  const uint64_t batches =
+    (total_steps <= 6) ? 1 : (uint64_t(1) << (total_steps - 6));
+  for (uint64_t batch = 0; batch < batches; ++batch) {
+
+    if (control && ((batch & 0xFFF) == 0) &&
+        !control->check_in(double(batch) / double(batches), best_open)) {
+      break;
+    }
+
+    const uint64_t base = batch * LANES;
+    std::fill(planes.begin(), planes.end(), 0);
+    std::fill(counter.begin(), counter.end(), 0);
+    planes[0] = ~uint64_t(0);
+
+    for (size_t k = 0; k < total_steps; ++k) {
+
+      // Every lane on row r moves right and stays on row r, or moves down
+      // to row r + 1. Lanes moving down off the last row drop out.
+      const uint64_t right = right_lanes(base, k);
+      const size_t d = k + 1;
+      const coordinate lowest = (d >= columns) ? d - columns + 1 : 0,
+                       highest = std::min<coordinate>(d, rows - 1);
+      uint64_t alive = 0, gained = 0;
+      for (coordinate r = highest + 1; r-- > lowest; ) {
+        uint64_t here = planes[r] & right;
+        if (r > 0) {
+          here |= planes[r - 1] & ~right;
+        }
+        if (blocked[d][r]) {
+          here = 0;
+        } else if (open[d][r]) {
+          gained |= here;
+        }
+        planes[r] = here;
+        alive |= here;
+      }
+      // Lanes moving right off the last column drop out.
+      if (lowest > 0) {
+        planes[lowest - 1] = 0;
+      }
+      if (alive == 0) {
+        break;
+      }
+
+      increment(counter, gained);
+      if (gained != 0) {
+        uint64_t better = greater_than(counter, best_open) & alive;
+        if (better != 0) {
+          unsigned lane = unsigned(__builtin_ctzll(better));
+          best_pattern = base + lane;
+          best_steps = k + 1;
+          best_open = lane_value(counter, lane);
+        }
+      }
+    }
+  }
+
+  phase.next("bitsliced: reconstruct path");
+
+  path best(setting);
+  for (size_t k = 0; k < best_steps; ++k) {
+    best.add_step(((best_pattern >> k) & 1) ? STEP_DIRECTION_RIGHT
+                                            : STEP_DIRECTION_DOWN);
+  }
+  assert(best.total_open() == best_open);
+  return best;
+}
+
+}
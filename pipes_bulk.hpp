@@ -0,0 +1,225 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_bulk.hpp
+//
+// Validate and score large batches of routes against one grid.
+//
+// Routes are packed direction bitstrings, one bit per step after the start
+// at (0, 0), with bit i of the route in bit i % 64 of word i / 64 and 1
+// meaning right, as in packed_path. The grid is stored as bit planes, once
+// row by row and once column by column, so that a run of k steps in the
+// same direction is checked for rocks and counted for open cells with a few
+// word operations on one plane, instead of k cell lookups. Runs themselves
+// are found by counting trailing ones or zeros of the route's words.
+//
+// Scoring allocates nothing per route; score_routes spreads the routes over
+// several threads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// A route to score: length steps, packed one bit per step.
+struct packed_route {
+  const uint64_t* bits;
+  size_t length;
+};
+
+// Outcome of scoring one route. When the route is invalid, the final cell
+// and open count describe its longest valid prefix.
+struct route_score {
+  bool valid;
+  coordinate final_row, final_column;
+  unsigned total_open;
+};
+
+// Pack directions, which may only be STEP_DIRECTION_RIGHT or
+// STEP_DIRECTION_DOWN, into the words of a packed_route.
+std::vector<uint64_t> pack_route(const std::vector<step_direction>& steps) {
+  std::vector<uint64_t> bits((steps.size() + 63) / 64, 0);
+  for (size_t i = 0; i < steps.size(); ++i) {
+    assert(steps[i] != STEP_DIRECTION_START);
+    if (steps[i] == STEP_DIRECTION_RIGHT) {
+      bits[i / 64] |= uint64_t(1) << (i % 64);
+    }
+  }
+  return bits;
+}
+
+namespace bulk_detail {
+
+// Mask of bits [from, to) within one word, for 0 <= from < to <= 64.
+uint64_t bit_range(unsigned from, unsigned to) {
+  uint64_t upto = (to == 64) ? ~uint64_t(0) : ((uint64_t(1) << to) - 1);
+  return upto & ~((uint64_t(1) << from) - 1);
+}
+
+// Length of the run of equal bits starting at bit i, capped at length - i.
+size_t run_length(const packed_route& route, size_t i) {
+  const bool right = (route.bits[i / 64] >> (i % 64)) & 1;
+  size_t end = i;
+  while (end < route.length) {
+    uint64_t word = route.bits[end / 64] >> (end % 64);
+    if (!right) {
+      word = ~word;
+    }
+    unsigned available = unsigned(64 - end % 64);
+    unsigned same = (word == ~uint64_t(0)) ? 64 : __builtin_ctzll(~word);
+    end += std::min(same, available);
+    if (same < available) {
+      break;
+    }
+  }
+  return std::min(end, route.length) - i;
+}
+
+}
+
+// A grid stored as rock and open bit planes in both row-major and
+// column-major order.
+class bitplane_grid {
+private:
+  coordinate rows_, columns_;
+  size_t row_words_, column_words_;
+  std::vector<uint64_t> row_rock_, row_open_, column_rock_, column_open_;
+
+  // First set bit of plane[line * words ...] in [from, to), or to if none.
+  static size_t first_set(const std::vector<uint64_t>& plane, size_t line,
+                          size_t words, size_t from, size_t to) {
+    const uint64_t* bits = &plane[line * words];
+    for (size_t at = from; at < to; ) {
+      unsigned low = unsigned(at % 64),
+               high = unsigned(std::min<size_t>(to - (at - low), 64));
+      uint64_t hit = bits[at / 64] & bulk_detail::bit_range(low, high);
+      if (hit != 0) {
+        return at - low + __builtin_ctzll(hit);
+      }
+      at += high - low;
+    }
+    return to;
+  }
+
+  // Set bits of plane[line * words ...] in [from, to).
+  static unsigned count_set(const std::vector<uint64_t>& plane, size_t line,
+                            size_t words, size_t from, size_t to) {
+    const uint64_t* bits = &plane[line * words];
+    unsigned count = 0;
+    for (size_t at = from; at < to; ) {
+      unsigned low = unsigned(at % 64),
+               high = unsigned(std::min<size_t>(to - (at - low), 64));
+      count += __builtin_popcountll(bits[at / 64] &
+                                    bulk_detail::bit_range(low, high));
+      at += high - low;
+    }
+    return count;
+  }
+
+public:
+
+  bitplane_grid(const grid& setting)
+  : rows_(setting.rows()),
+    columns_(setting.columns()),
+    row_words_((columns_ + 63) / 64),
+    column_words_((rows_ + 63) / 64),
+    row_rock_(rows_ * row_words_, 0),
+    row_open_(rows_ * row_words_, 0),
+    column_rock_(columns_ * column_words_, 0),
+    column_open_(columns_ * column_words_, 0) {
+
+    for (coordinate r = 0; r < rows_; ++r) {
+      for (coordinate c = 0; c < columns_; ++c) {
+        auto cell = setting.get(r, c);
+        if (cell == CELL_SOIL) {
+          continue;
+        }
+        auto& by_row = (cell == CELL_ROCK) ? row_rock_ : row_open_;
+        auto& by_column = (cell == CELL_ROCK) ? column_rock_ : column_open_;
+        by_row[r * row_words_ + c / 64] |= uint64_t(1) << (c % 64);
+        by_column[c * column_words_ + r / 64] |= uint64_t(1) << (r % 64);
+      }
+    }
+  }
+
+  coordinate rows() const { return rows_; }
+  coordinate columns() const { return columns_; }
+
+  // Validate and score one route starting at (0, 0).
+  route_score score(const packed_route& route) const {
+    route_score result{true, 0, 0, 0};
+    for (size_t i = 0; i < route.length; ) {
+      size_t run = bulk_detail::run_length(route, i);
+      bool right = (route.bits[i / 64] >> (i % 64)) & 1;
+      coordinate& along = right ? result.final_column : result.final_row;
+      coordinate line = right ? result.final_row : result.final_column,
+                 limit = right ? columns_ : rows_;
+      const auto& rock = right ? row_rock_ : column_rock_;
+      const auto& open = right ? row_open_ : column_open_;
+      size_t words = right ? row_words_ : column_words_;
+
+      // Cells entered by this run are along + 1 .. along + run; stop short
+      // of the first rock or the edge.
+      size_t end = std::min<size_t>(along + 1 + run, limit);
+      end = first_set(rock, line, words, along + 1, end);
+      result.total_open += count_set(open, line, words, along + 1, end);
+      if (end != along + 1 + run) {
+        result.valid = false;
+        along = end - 1;
+        break;
+      }
+      along = end - 1;
+      i += run;
+    }
+    return result;
+  }
+};
+
+// Score count routes into out[0 .. count), using up to threads threads.
+// Each route is scored independently, as bitplane_grid::score.
+void score_routes(const bitplane_grid& setting,
+                  const packed_route* routes, size_t count,
+                  route_score* out,
+                  unsigned threads = std::thread::hardware_concurrency()) {
+
+  trace_scope trace("bulk: score routes");
+
+  // Threads claim routes in blocks, so uneven routes balance out.
+  const size_t BLOCK = 1024;
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (;;) {
+      size_t begin = next.fetch_add(BLOCK);
+      if (begin >= count) {
+        return;
+      }
+      size_t end = std::min(count, begin + BLOCK);
+      for (size_t k = begin; k < end; ++k) {
+        out[k] = setting.score(routes[k]);
+      }
+    }
+  };
+
+  threads = std::max(1u, std::min<unsigned>(threads,
+                                             unsigned((count + BLOCK - 1) /
+                                                      BLOCK)));
+  std::vector<std::thread> helpers;
+  for (unsigned t = 1; t < threads; ++t) {
+    helpers.emplace_back(work);
+  }
+  work();
+  for (auto& h : helpers) {
+    h.join();
+  }
+}
+
+}
@@ -0,0 +1,273 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_cache.hpp
+//
+// A thread-safe cache of solved grids, so that a map which has already been
+// solved is answered without running a solver again.
+//
+// Grids are packed two bits per cell and hashed word by word. Each entry
+// keeps the packed grid, to rule out hash collisions, and the solution's
+// steps packed one bit per step. Entries are evicted least recently used
+// first once their total size passes a memory cap.
+//
+// Solvers do not all give the same answer for a grid: a narrow beam or a
+// solve cut short by a deadline may return a worse path. So every entry is
+// also keyed by a tag naming the solver, and its settings, that produced it,
+// and a lookup only finds entries made under the same tag.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// A grid packed two bits per cell, 32 cells per word. Each row starts on a
+// word boundary, and unused bits are zero.
+class packed_grid {
+private:
+  coordinate rows_, columns_, words_per_row_;
+  std::vector<uint64_t> words_;
+
+public:
+
+  static constexpr coordinate CELLS_PER_WORD = 32;
+
+  packed_grid(const grid& setting)
+  : rows_(setting.rows()),
+    columns_(setting.columns()),
+    words_per_row_((setting.columns() + CELLS_PER_WORD - 1) / CELLS_PER_WORD),
+    words_(rows_ * words_per_row_, 0) {
+
+    for (coordinate r = 0; r < rows_; ++r) {
+      uint64_t* row = &words_[r * words_per_row_];
+      for (coordinate c = 0; c < columns_; ++c) {
+        row[c / CELLS_PER_WORD] |=
+          uint64_t(setting.get(r, c)) << (2 * (c % CELLS_PER_WORD));
+      }
+    }
+  }
+
+  // Accessors.
+  coordinate rows() const { return rows_; }
+  coordinate columns() const { return columns_; }
+  const std::vector<uint64_t>& words() const { return words_; }
+
+  // Hash the dimensions and cells. The words are mixed in four independent
+  // lanes, so the loop has no serial dependency between neighbouring words
+  // and compilers can keep the lanes in vector registers.
+  uint64_t hash() const {
+    const uint64_t PRIME = 0x9E3779B97F4A7C15ULL;
+    uint64_t lanes[4] = {rows_, columns_, PRIME, ~PRIME};
+
+    const size_t n = words_.size(), whole = n - (n % 4);
+    for (size_t i = 0; i < whole; i += 4) {
+      for (size_t lane = 0; lane < 4; ++lane) {
+        uint64_t h = (lanes[lane] ^ words_[i + lane]) * PRIME;
+        lanes[lane] = h ^ (h >> 29);
+      }
+    }
+    for (size_t i = whole; i < n; ++i) {
+      uint64_t h = (lanes[i % 4] ^ words_[i]) * PRIME;
+      lanes[i % 4] = h ^ (h >> 29);
+    }
+
+    uint64_t result = n;
+    for (auto lane : lanes) {
+      result = (result ^ lane) * PRIME;
+      result ^= result >> 32;
+    }
+    return result;
+  }
+
+  bool operator==(const packed_grid& o) const {
+    return (rows_ == o.rows_) && (columns_ == o.columns_) &&
+           (words_ == o.words_);
+  }
+};
+
+// A path's start cell, and its steps packed one bit per step after
+// STEP_DIRECTION_START, with 1 meaning STEP_DIRECTION_RIGHT and 0 meaning
+// STEP_DIRECTION_DOWN.
+class packed_path {
+private:
+  coordinate start_row_, start_column_;
+  size_t length_;
+  std::vector<uint64_t> bits_;
+
+public:
+
+  packed_path(const path& p)
+  : start_row_(p.start_row()),
+    start_column_(p.start_column()),
+    length_(p.steps().size() - 1),
+    bits_((length_ + 63) / 64, 0) {
+
+    for (size_t i = 0; i < length_; ++i) {
+      if (p.steps()[i + 1].direction() == STEP_DIRECTION_RIGHT) {
+        bits_[i / 64] |= uint64_t(1) << (i % 64);
+      }
+    }
+  }
+
+  // Number of steps after STEP_DIRECTION_START.
+  size_t length() const { return length_; }
+
+  // Approximate memory used, in bytes.
+  size_t bytes() const { return sizeof(*this) + bits_.size() * 8; }
+
+  // Rebuild the path on the given grid, which must have the same cells as
+  // the grid the path was packed from.
+  path unpack(const grid& setting) const {
+    std::vector<step_direction> steps(length_);
+    for (size_t i = 0; i < length_; ++i) {
+      steps[i] = ((bits_[i / 64] >> (i % 64)) & 1) ? STEP_DIRECTION_RIGHT
+                                                   : STEP_DIRECTION_DOWN;
+    }
+    return path(setting, start_row_, start_column_, steps);
+  }
+};
+
+// Counters describing cache behaviour since it was created.
+struct cache_stats {
+  size_t hits = 0, misses = 0, evictions = 0;
+  size_t entries = 0, bytes = 0;
+};
+
+// Thread-safe LRU cache from a solver tag and grid contents to solutions.
+//
+// Tags are chosen by the caller, for instance "dyn_prog" or "beam:64". Use a
+// distinct tag for every solver and setting that can give a different path,
+// and do not insert a result that a deadline or cancellation cut short
+// under the tag of a solver that would otherwise have finished.
+class solve_cache {
+private:
+
+  struct entry {
+    uint64_t hash;
+    std::string tag;
+    packed_grid cells;
+    packed_path solution;
+
+    size_t bytes() const {
+      return sizeof(*this) + tag.size() + cells.words().size() * 8 +
+             solution.bytes();
+    }
+  };
+
+  size_t max_bytes_;
+  mutable std::mutex mutex_;
+  // Most recently used first.
+  std::list<entry> entries_;
+  std::unordered_map<uint64_t, std::list<entry>::iterator> index_;
+  cache_stats stats_;
+
+  // Hash of a tag and packed grid together.
+  static uint64_t key_hash(const std::string& tag, const packed_grid& cells) {
+    const uint64_t PRIME = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = (cells.hash() ^ std::hash<std::string>()(tag)) * PRIME;
+    return h ^ (h >> 32);
+  }
+
+  // Remove one entry. The mutex must be held.
+  void erase(std::list<entry>::iterator it) {
+    stats_.bytes -= it->bytes();
+    --stats_.entries;
+    index_.erase(it->hash);
+    entries_.erase(it);
+  }
+
+public:
+
+  // Create an empty cache holding at most max_bytes of entries.
+  solve_cache(size_t max_bytes)
+  : max_bytes_(max_bytes) { }
+
+  // Return the solution cached for setting under tag, if there is one,
+  // rebuilt on setting itself.
+  std::optional<path> lookup(const std::string& tag, const grid& setting) {
+    packed_grid cells(setting);
+    uint64_t hash = key_hash(tag, cells);
+
+    std::optional<packed_path> found;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(hash);
+      if ((it != index_.end()) && (it->second->tag == tag) &&
+          (it->second->cells == cells)) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        found = it->second->solution;
+        ++stats_.hits;
+      } else {
+        ++stats_.misses;
+      }
+    }
+
+    if (!found) {
+      return std::nullopt;
+    }
+    return found->unpack(setting);
+  }
+
+  // Store the solution for setting under tag, replacing any entry with the
+  // same hash, then evict old entries until the cache fits its cap. A
+  // solution too large for the cap on its own is not stored.
+  void insert(const std::string& tag, const grid& setting,
+              const path& solution) {
+    assert(&solution.setting() == &setting);
+
+    packed_grid cells(setting);
+    uint64_t hash = key_hash(tag, cells);
+    entry fresh{hash, tag, std::move(cells), packed_path(solution)};
+    if (fresh.bytes() > max_bytes_) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(hash);
+    if (it != index_.end()) {
+      erase(it->second);
+    }
+    stats_.bytes += fresh.bytes();
+    ++stats_.entries;
+    entries_.push_front(std::move(fresh));
+    index_[hash] = entries_.begin();
+
+    while (stats_.bytes > max_bytes_) {
+      erase(std::prev(entries_.end()));
+      ++stats_.evictions;
+    }
+  }
+
+  // Return the solution cached for setting under tag, or solve it with
+  // solver(setting), cache the result under tag, and return it. tag must
+  // name solver as described above. The solver runs without holding the
+  // lock, so concurrent misses on the same grid may both solve it.
+  template <typename Solver>
+  path solve(const std::string& tag, const grid& setting, Solver&& solver) {
+    if (auto cached = lookup(tag, setting)) {
+      return *cached;
+    }
+    path solution = solver(setting);
+    insert(tag, setting, solution);
+    return solution;
+  }
+
+  // Return a snapshot of the counters.
+  cache_stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+};
+
+}
@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_control.hpp
+//
+// Cooperative cancellation, deadlines, and progress reporting for the
+// economical pipes solvers.
+//
+// A solver that accepts a solve_control pointer calls check_in() at cheap
+// intervals, such as once per row or once per few thousand bit patterns.
+// check_in() reports progress and tells the solver whether to keep going; a
+// solver told to stop returns the best path it has found so far.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace pipes {
+
+// How a solve ended.
+enum solve_status {
+  SOLVE_RUNNING,
+  SOLVE_COMPLETE,
+  SOLVE_CANCELLED,
+  SOLVE_DEADLINE_EXPIRED
+};
+
+// A snapshot of a running solve: the fraction of work done, between 0 and 1,
+// and the most open cells in any path found so far.
+struct solve_progress {
+  double fraction_done;
+  unsigned best_open;
+};
+
+// Settings for a controlled solve.
+struct solve_options {
+
+  using clock = std::chrono::steady_clock;
+
+  // Stop once this time passes. The default never expires.
+  clock::time_point deadline = clock::time_point::max();
+
+  // Called from the solving thread with the latest progress, at most once
+  // per progress_interval. May be empty.
+  std::function<void(const solve_progress&)> on_progress;
+  clock::duration progress_interval = std::chrono::milliseconds(100);
+};
+
+// Shared state between a running solver and whoever is waiting on it.
+// cancel() may be called from any thread; check_in() is only called by the
+// solver.
+class solve_control {
+private:
+  using clock = solve_options::clock;
+
+  solve_options options_;
+  std::atomic<bool> cancel_requested_;
+  std::atomic<solve_status> status_;
+  clock::time_point next_progress_;
+
+public:
+
+  solve_control(const solve_options& options = solve_options())
+  : options_(options),
+    cancel_requested_(false),
+    status_(SOLVE_RUNNING),
+    next_progress_(clock::now()) { }
+
+  // Ask the solver to stop at its next check-in.
+  void cancel() { cancel_requested_.store(true, std::memory_order_relaxed); }
+
+  // Return SOLVE_RUNNING until the solver stops or finish() is called.
+  solve_status status() const { return status_.load(); }
+
+  // Called by the solver with its current progress. Returns true if the
+  // solver should keep going, or false, after recording why, if it should
+  // stop.
+  bool check_in(double fraction_done, unsigned best_open) {
+
+    if (cancel_requested_.load(std::memory_order_relaxed)) {
+      status_.store(SOLVE_CANCELLED);
+      return false;
+    }
+
+    auto now = clock::now();
+    if (now >= options_.deadline) {
+      status_.store(SOLVE_DEADLINE_EXPIRED);
+      return false;
+    }
+
+    if (options_.on_progress && (now >= next_progress_)) {
+      options_.on_progress(solve_progress{fraction_done, best_open});
+      next_progress_ = now + options_.progress_interval;
+    }
+    return true;
+  }
+
+  // Called once the solver returns. Marks the solve complete unless it was
+  // already stopped early.
+  void finish() {
+    solve_status expected = SOLVE_RUNNING;
+    status_.compare_exchange_strong(expected, SOLVE_COMPLETE);
+  }
+};
+
+}
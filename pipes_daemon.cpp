@@ -0,0 +1,420 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_daemon.cpp
+//
+// Long-running economical pipes solver.
+//
+// Usage:
+//
+//    pipes_daemon [--socket PATH] [--threads N] [--max-cells M]
+//
+// Without --socket, requests are read from stdin and responses written to
+// stdout. With --socket, the daemon listens on a Unix domain socket at PATH
+// and serves any number of clients at once. Messages use the framing in
+// pipes_protocol.hpp.
+//
+// Each request passes through three stages on separate threads: a reader
+// per client decodes frames, a pool of N solver threads solves them, each
+// keeping a warm dyn_prog_workspace, and a writer per client encodes and
+// sends the responses. Responses on one connection may arrive out of order
+// when N > 1; clients match them up by id.
+//
+// Grids of more than M cells, pipes::DEFAULT_MAX_CELLS by default, are
+// answered RESPONSE_MALFORMED without being read into memory.
+//
+// The queue in front of the solvers holds a few jobs per solver, and each
+// client may only have so many requests between being read and being
+// answered. When either is full, the reader stops reading that client's
+// requests until the solvers or the client catch up.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "pipes_protocol.hpp"
+#include "pipes_workspace.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+// Jobs queued per solver thread.
+const size_t QUEUED_JOBS_PER_SOLVER = 4;
+
+// Largest --max-cells whose requests still fit a frame's 32-bit length.
+const size_t MAX_CELLS_LIMIT = 4 * (size_t(UINT32_MAX) - 20);
+
+// A queue between two pipeline stages. push() blocks while the queue holds
+// capacity items, and pop() until an item arrives or the queue is closed and
+// drained. Items pushed after close() are dropped.
+template <typename T>
+class blocking_queue {
+private:
+  std::mutex mutex_;
+  std::condition_variable ready_, space_;
+  std::deque<T> items_;
+  size_t capacity_;
+  bool closed_ = false;
+
+public:
+  blocking_queue(size_t capacity = SIZE_MAX) : capacity_(capacity) { }
+
+  void push(T item) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      space_.wait(lock, [&]() {
+        return closed_ || (items_.size() < capacity_);
+      });
+      if (closed_) {
+        return;
+      }
+      items_.push_back(std::move(item));
+    }
+    ready_.notify_one();
+  }
+
+  std::optional<T> pop() {
+    std::optional<T> item;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [&]() { return closed_ || !items_.empty(); });
+      if (items_.empty()) {
+        return std::nullopt;
+      }
+      item = std::move(items_.front());
+      items_.pop_front();
+    }
+    space_.notify_one();
+    return item;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    ready_.notify_all();
+    space_.notify_all();
+  }
+};
+
+// Request counters and a latency histogram with one bucket per power of two
+// nanoseconds.
+class stats_collector {
+private:
+  std::mutex mutex_;
+  clock_type::time_point started_ = clock_type::now();
+  pipes::daemon_stats totals_;
+  std::vector<uint64_t> buckets_ = std::vector<uint64_t>(64, 0);
+
+  uint64_t percentile(double fraction) const {
+    uint64_t target = uint64_t(fraction * totals_.requests), seen = 0;
+    for (size_t b = 0; b < buckets_.size(); ++b) {
+      seen += buckets_[b];
+      if (seen > target) {
+        return uint64_t(1) << b;
+      }
+    }
+    return 0;
+  }
+
+public:
+  void record(clock_type::duration latency, bool error) {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    latency).count();
+    size_t bucket = 0;
+    while ((bucket < 63) && ((uint64_t(1) << bucket) < ns)) {
+      ++bucket;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++totals_.requests;
+    if (error) {
+      ++totals_.errors;
+    }
+    totals_.total_latency_ns += ns;
+    totals_.max_latency_ns = std::max(totals_.max_latency_ns, ns);
+    ++buckets_[bucket];
+  }
+
+  pipes::daemon_stats snapshot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pipes::daemon_stats result = totals_;
+    result.uptime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         clock_type::now() - started_).count();
+    result.p50_latency_ns = percentile(0.50);
+    result.p99_latency_ns = percentile(0.99);
+    return result;
+  }
+};
+
+// A response on its way to the writer stage, which encodes it.
+struct reply {
+  bool is_stats;
+  pipes::solve_response response;
+  pipes::daemon_stats stats;
+  clock_type::time_point received;
+};
+
+// One client. The reader stage owns input, the writer stage owns output,
+// and the connection closes once input has ended and every request read
+// has been answered. A request is in flight from when it is read until the
+// writer has sent its response.
+class connection {
+private:
+  std::mutex mutex_;
+  std::condition_variable space_;
+  bool reading_ = true;
+  size_t in_flight_ = 0;
+
+  void close_if_done() {
+    if (!reading_ && (in_flight_ == 0)) {
+      outgoing.close();
+    }
+  }
+
+public:
+  int in, out;
+  // Responses waiting for the writer stage.
+  blocking_queue<reply> outgoing;
+
+  connection(int in_fd, int out_fd) : in(in_fd), out(out_fd) { }
+
+  // Wait until fewer than pipes::MAX_IN_FLIGHT requests are in flight,
+  // then count one more.
+  void request_started() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_.wait(lock, [&]() {
+      return in_flight_ < pipes::MAX_IN_FLIGHT;
+    });
+    ++in_flight_;
+  }
+
+  void request_finished() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --in_flight_;
+      close_if_done();
+    }
+    space_.notify_one();
+  }
+
+  void input_ended() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reading_ = false;
+    close_if_done();
+  }
+};
+
+// A decoded request on its way to the solver stage.
+struct job {
+  std::shared_ptr<connection> client;
+  pipes::solve_request request;
+  clock_type::time_point received;
+};
+
+stats_collector stats;
+size_t max_cells = pipes::DEFAULT_MAX_CELLS;
+// Created in main once the number of solvers is known.
+std::unique_ptr<blocking_queue<job>> jobs;
+
+// Solver stage: runs until the job queue closes.
+void solve_jobs() {
+  pipes::dyn_prog_workspace workspace;
+  while (auto next = jobs->pop()) {
+    pipes::solve_response response;
+    response.id = next->request.id;
+    if (next->request.valid(max_cells)) {
+      const auto& solution = workspace.solve(
+        next->request.rows, next->request.columns,
+        [&](pipes::coordinate r, pipes::coordinate c) {
+          return next->request.get(r, c);
+        });
+      response.total_open = solution.total_open;
+      response.set_steps(solution.steps);
+    } else {
+      response.status = pipes::RESPONSE_MALFORMED;
+    }
+    next->client->outgoing.push(
+      reply{false, std::move(response), {}, next->received});
+  }
+}
+
+// Reader stage for one client.
+void read_requests(std::shared_ptr<connection> client) {
+  try {
+    std::vector<uint8_t> payload;
+    bool oversized;
+    while (pipes::read_frame(client->in, payload,
+                             pipes::solve_request_bytes(max_cells),
+                             &oversized)) {
+      client->request_started();
+      auto kind = pipes::message_kind_of(payload);
+      if ((kind == pipes::MESSAGE_STATS) && !oversized) {
+        client->outgoing.push(
+          reply{true, {}, stats.snapshot(), clock_type::now()});
+        continue;
+      }
+      job next{client, pipes::solve_request(), clock_type::now()};
+      if (oversized || !pipes::decode(payload, next.request)) {
+        // Still answer, so the client is not left waiting.
+        next.request.id = pipes::request_id_of(payload);
+        next.request.rows = next.request.columns = 0;
+      }
+      jobs->push(std::move(next));
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "pipes_daemon: " << e.what() << std::endl;
+  }
+  client->input_ended();
+}
+
+// Writer stage for one client: encode, count, and send each response.
+// Closes the client's descriptors when done.
+void write_responses(std::shared_ptr<connection> client) {
+  bool healthy = true;
+  std::vector<uint8_t> payload;
+  while (auto next = client->outgoing.pop()) {
+    if (next->is_stats) {
+      payload = pipes::encode(next->stats);
+    } else {
+      payload = pipes::encode(next->response);
+      stats.record(clock_type::now() - next->received,
+                   next->response.status != pipes::RESPONSE_OK);
+    }
+    if (healthy) {
+      try {
+        pipes::write_frame(client->out, payload);
+      } catch (const std::exception& e) {
+        std::cerr << "pipes_daemon: " << e.what() << std::endl;
+        healthy = false;
+      }
+    }
+    client->request_finished();
+  }
+  ::close(client->in);
+  if (client->out != client->in) {
+    ::close(client->out);
+  }
+}
+
+// Parse a whole decimal argument between 1 and max.
+bool parse_count(const char* text, unsigned long long max,
+                 unsigned long long& value) {
+  char* end;
+  errno = 0;
+  long long parsed = std::strtoll(text, &end, 10);
+  if ((end == text) || (*end != '\0') || (errno == ERANGE) ||
+      (parsed < 1) || (static_cast<unsigned long long>(parsed) > max)) {
+    return false;
+  }
+  value = static_cast<unsigned long long>(parsed);
+  return true;
+}
+
+void usage() {
+  std::cerr << "usage: pipes_daemon [--socket PATH] [--threads N] "
+            << "[--max-cells M]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+  std::string socket_path;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    unsigned long long value = 0;
+    if ((arg == "--socket") && (i + 1 < argc)) {
+      socket_path = argv[++i];
+    } else if ((arg == "--threads") && (i + 1 < argc) &&
+               parse_count(argv[++i], 1024, value)) {
+      threads = unsigned(value);
+    } else if ((arg == "--max-cells") && (i + 1 < argc) &&
+               parse_count(argv[++i], MAX_CELLS_LIMIT, value)) {
+      max_cells = size_t(value);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  // A client that hangs up should not kill the daemon.
+  std::signal(SIGPIPE, SIG_IGN);
+
+  jobs = std::make_unique<blocking_queue<job>>(
+    QUEUED_JOBS_PER_SOLVER * threads);
+  std::vector<std::thread> solvers;
+  for (unsigned i = 0; i < threads; ++i) {
+    solvers.emplace_back(solve_jobs);
+  }
+
+  if (socket_path.empty()) {
+    auto client = std::make_shared<connection>(STDIN_FILENO, STDOUT_FILENO);
+    std::thread writer(write_responses, client);
+    read_requests(client);
+    writer.join();
+    jobs->close();
+    for (auto& t : solvers) {
+      t.join();
+    }
+    return 0;
+  }
+
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if ((listener < 0) ||
+      (socket_path.size() >= sizeof(address.sun_path))) {
+    std::cerr << "pipes_daemon: cannot create socket " << socket_path
+              << std::endl;
+    return 1;
+  }
+  std::strncpy(address.sun_path, socket_path.c_str(),
+               sizeof(address.sun_path) - 1);
+  ::unlink(socket_path.c_str());
+  if ((::bind(listener, reinterpret_cast<sockaddr*>(&address),
+              sizeof(address)) < 0) ||
+      (::listen(listener, 64) < 0)) {
+    std::cerr << "pipes_daemon: cannot listen on " << socket_path << ": "
+              << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  for (;;) {
+    int fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "pipes_daemon: accept: " << std::strerror(errno)
+                << std::endl;
+      break;
+    }
+    auto client = std::make_shared<connection>(fd, fd);
+    std::thread(read_requests, client).detach();
+    std::thread(write_responses, client).detach();
+  }
+
+  jobs->close();
+  for (auto& t : solvers) {
+    t.join();
+  }
+  ::close(listener);
+  return 1;
+}
@@ -0,0 +1,389 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_dispatch.hpp
+//
+// Pick an economical pipes solver automatically.
+//
+// econ_pipes_solve measures a few features of the grid (its shape and how
+// many open, rock and run cells it has), predicts how long each solver
+// would take and how much memory it would need, and runs the fastest one
+// that fits within the memory limit.
+//
+// Predictions come from a cost_model: for each solver, a fixed cost plus a
+// cost per unit of work, where the unit depends on the solver's algorithm.
+// cost_model::calibrate() fits those two numbers by timing every solver on
+// a small and a larger grid, and cost_model::load_or_calibrate() keeps the
+// result in a file so it only has to be measured once per machine.
+//
+// Usage:
+//
+//    auto model = pipes::cost_model::load_or_calibrate("pipes_cost_model.txt");
+//    pipes::dispatch_options options;
+//    options.model = &model;
+//    auto best = pipes::econ_pipes_solve(setting, options);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "pipes_bands.hpp"
+#include "pipes_bitslice.hpp"
+#include "pipes_narrow.hpp"
+#include "pipes_rle.hpp"
+#include "pipes_sparse.hpp"
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// The solvers econ_pipes_solve chooses between.
+enum solver_kind {
+  SOLVER_EXHAUSTIVE,  // econ_pipes_bitsliced
+  SOLVER_DYN_PROG,    // econ_pipes_narrow
+  SOLVER_SPARSE,      // econ_pipes_sparse
+  SOLVER_RLE,         // econ_pipes_rle
+  SOLVER_BANDS,       // econ_pipes_bands, one process per core
+  SOLVER_KIND_COUNT
+};
+
+const char* solver_name(solver_kind kind) {
+  static const char* names[SOLVER_KIND_COUNT] = {
+    "exhaustive", "dyn_prog", "sparse", "rle", "bands"
+  };
+  assert(kind < SOLVER_KIND_COUNT);
+  return names[kind];
+}
+
+// What the cost model knows about a grid.
+struct grid_features {
+  coordinate rows, columns;
+  size_t open, rocks;
+
+  // Runs of identical cells, summed over all rows.
+  size_t runs;
+
+  static grid_features of(const grid& setting) {
+    grid_features result{setting.rows(), setting.columns(), 0, 0, 0};
+    for (coordinate r = 0; r < setting.rows(); ++r) {
+      for (coordinate c = 0; c < setting.columns(); ++c) {
+        auto cell = setting.get(r, c);
+        result.open += (cell == CELL_OPEN);
+        result.rocks += (cell == CELL_ROCK);
+        result.runs += (c == 0) || (cell != setting.get(r, c - 1));
+      }
+    }
+    return result;
+  }
+};
+
+class cost_model;
+
+// Settings for econ_pipes_solve.
+struct dispatch_options {
+
+  // Cores the parallel solvers may use.
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+  // Largest working memory, in bytes, a chosen solver may need.
+  size_t memory_limit = std::numeric_limits<size_t>::max();
+
+  // Cost model to predict with. When null, cost_model::defaults() is used.
+  const cost_model* model = nullptr;
+
+  // Whether solvers that fork worker processes may be chosen. Off by
+  // default, since forking is unsafe in a process with other threads
+  // holding locks, such as a server.
+  bool use_processes = false;
+};
+
+// Predicted cost of each solver on a grid.
+class cost_model {
+private:
+
+  // Predicted time is fixed_ns + unit_ns * work_units.
+  struct term {
+    double fixed_ns, unit_ns;
+  };
+
+  term terms_[SOLVER_KIND_COUNT];
+
+  static constexpr const char* FILE_HEADER = "pipes_cost_model 2";
+
+  // The exhaustive search is only considered up to this many steps.
+  static const size_t EXHAUSTIVE_MAX_STEPS = 40;
+
+  // The sparse solver is only considered when at most one cell in this
+  // many is open or rock. Each of those costs it a tree update, far more
+  // than a dense solver spends per cell, so it cannot win on denser grids,
+  // and its calibration grids are this sparse.
+  static const size_t SPARSE_MIN_CELLS_PER_POINT = 64;
+
+  // Bands the parallel solver would use.
+  static size_t band_count(const grid_features& f, unsigned cores) {
+    return std::min<size_t>(cores, f.rows);
+  }
+
+public:
+
+  // Return whether a solver can run on a grid of this shape at all.
+  static bool applicable(solver_kind kind, const grid_features& f,
+                         unsigned cores) {
+    switch (kind) {
+    case SOLVER_EXHAUSTIVE:
+      return f.rows + f.columns - 2 <= EXHAUSTIVE_MAX_STEPS;
+    case SOLVER_SPARSE:
+      return (f.open + f.rocks) * SPARSE_MIN_CELLS_PER_POINT <=
+             f.rows * f.columns;
+    case SOLVER_BANDS:
+      return band_count(f, cores) > 1;
+    default:
+      return true;
+    }
+  }
+
+  // Work units of a solver on a grid, in the units its term is fitted in.
+  static double work_units(solver_kind kind, const grid_features& f,
+                           unsigned cores) {
+    const double cells = double(f.rows) * double(f.columns);
+    const double steps = double(f.rows + f.columns - 2);
+    switch (kind) {
+    case SOLVER_EXHAUSTIVE:
+      // Batches of 64 patterns, each walking every step over every row.
+      return std::pow(2.0, std::max(0.0, steps - 6)) *
+             std::max(1.0, steps) * double(f.rows);
+    case SOLVER_DYN_PROG:
+      return cells;
+    case SOLVER_SPARSE: {
+      // A scan to find the interesting cells, then a chain DP over them.
+      double k = double(f.open + f.rocks);
+      return cells + k * std::log2(k + 2);
+    }
+    case SOLVER_RLE:
+      return cells + double(f.runs);
+    case SOLVER_BANDS:
+      // The cells are split across the bands, which run in a pipeline.
+      return cells / double(band_count(f, cores));
+    default:
+      assert(false);
+      return 0;
+    }
+  }
+
+  // Approximate peak working memory of a solver on a grid, in bytes.
+  static double memory_bytes(solver_kind kind, const grid_features& f,
+                             unsigned cores) {
+    const double cells = double(f.rows) * double(f.columns);
+    const double edge = double(f.rows + f.columns);
+    switch (kind) {
+    case SOLVER_EXHAUSTIVE:
+      return 2 * edge * double(f.rows) + 64 * edge;
+    case SOLVER_DYN_PROG:
+      return cells * (score_type_fits<uint8_t>(f.rows, f.columns) ? 1 :
+                      score_type_fits<uint16_t>(f.rows, f.columns) ? 2 : 4) +
+             4 * edge;
+    case SOLVER_SPARSE:
+      return 64 * double(f.open + f.rocks) + 32 * edge;
+    case SOLVER_RLE:
+      return 48 * double(f.runs) + 16 * edge;
+    case SOLVER_BANDS:
+      return cells + 16 * double(f.columns) * double(band_count(f, cores)) +
+             8 * edge;
+    default:
+      assert(false);
+      return 0;
+    }
+  }
+
+  // Rough coefficients, for when no calibrated model is available.
+  static cost_model defaults() {
+    cost_model m;
+    m.terms_[SOLVER_EXHAUSTIVE] = term{2e3, 2.0};
+    m.terms_[SOLVER_DYN_PROG] = term{1e3, 4.0};
+    m.terms_[SOLVER_SPARSE] = term{5e3, 30.0};
+    m.terms_[SOLVER_RLE] = term{3e3, 10.0};
+    m.terms_[SOLVER_BANDS] = term{5e5, 3.0};
+    return m;
+  }
+
+  // Predicted nanoseconds for a solver on a grid.
+  double predict_ns(solver_kind kind, const grid_features& f,
+                    unsigned cores) const {
+    return terms_[kind].fixed_ns +
+           terms_[kind].unit_ns * work_units(kind, f, cores);
+  }
+
+  // The applicable solver with the least predicted time among those that
+  // fit in options.memory_limit, or, if none fit, the one needing the
+  // least memory. Process-based solvers are left out unless
+  // options.use_processes is set.
+  solver_kind choose(const grid_features& f,
+                     const dispatch_options& options) const {
+    std::optional<solver_kind> fastest, smallest;
+    for (int k = 0; k < SOLVER_KIND_COUNT; ++k) {
+      auto kind = solver_kind(k);
+      if (!applicable(kind, f, options.cores) ||
+          ((kind == SOLVER_BANDS) && !options.use_processes)) {
+        continue;
+      }
+      double memory = memory_bytes(kind, f, options.cores);
+      if (!smallest || (memory < memory_bytes(*smallest, f, options.cores))) {
+        smallest = kind;
+      }
+      if ((memory <= double(options.memory_limit)) &&
+          (!fastest || (predict_ns(kind, f, options.cores) <
+                        predict_ns(*fastest, f, options.cores)))) {
+        fastest = kind;
+      }
+    }
+    assert(smallest);
+    return fastest ? *fastest : *smallest;
+  }
+
+  // Fit every solver's term by timing it on two random grids of different
+  // sizes. Solvers that cannot run with this many cores, and process-based
+  // ones unless use_processes is set, keep their default terms. Takes
+  // about a second.
+  static cost_model calibrate(unsigned cores =
+                                std::max(1u,
+                                         std::thread::hardware_concurrency()),
+                              bool use_processes = false);
+
+  // Write the model as text. Returns false if the file cannot be written.
+  bool save(const std::string& filename) const {
+    std::ofstream out(filename);
+    out << FILE_HEADER << std::endl;
+    out.precision(17);
+    for (int k = 0; k < SOLVER_KIND_COUNT; ++k) {
+      out << solver_name(solver_kind(k)) << ' ' << terms_[k].fixed_ns << ' '
+          << terms_[k].unit_ns << std::endl;
+    }
+    return bool(out);
+  }
+
+  // Read a model written by save(). Returns no model if the file is
+  // missing or malformed.
+  static std::optional<cost_model> load(const std::string& filename) {
+    std::ifstream in(filename);
+    std::string header;
+    if (!std::getline(in, header) || (header != FILE_HEADER)) {
+      return std::nullopt;
+    }
+    cost_model m;
+    for (int k = 0; k < SOLVER_KIND_COUNT; ++k) {
+      std::string name;
+      if (!(in >> name >> m.terms_[k].fixed_ns >> m.terms_[k].unit_ns) ||
+          (name != solver_name(solver_kind(k)))) {
+        return std::nullopt;
+      }
+    }
+    return m;
+  }
+
+  // Load the model in filename, or calibrate one and save it there.
+  static cost_model load_or_calibrate(const std::string& filename,
+                                      bool use_processes = false) {
+    if (auto m = load(filename)) {
+      return *m;
+    }
+    auto m = calibrate(std::max(1u, std::thread::hardware_concurrency()),
+                       use_processes);
+    m.save(filename);
+    return m;
+  }
+};
+
+// Run one solver.
+path econ_pipes_solve_with(const grid& setting, solver_kind kind,
+                           unsigned cores =
+                             std::max(1u, std::thread::hardware_concurrency())) {
+  switch (kind) {
+  case SOLVER_EXHAUSTIVE:
+    return econ_pipes_bitsliced(setting);
+  case SOLVER_DYN_PROG:
+    return econ_pipes_narrow(setting).to_path(setting);
+  case SOLVER_SPARSE:
+    return econ_pipes_sparse(setting);
+  case SOLVER_RLE:
+    return econ_pipes_rle(rle_grid::from_grid(setting)).to_path(setting);
+  case SOLVER_BANDS: {
+    band_options options;
+    options.bands = std::min<size_t>(cores, setting.rows());
+    return econ_pipes_bands(setting, options);
+  }
+  default:
+    assert(false);
+    return path(setting);
+  }
+}
+
+cost_model cost_model::calibrate(unsigned cores, bool use_processes) {
+
+  trace_scope trace("dispatch: calibrate");
+
+  using clock = std::chrono::steady_clock;
+  std::mt19937 gen(40);
+  // 20% open and 10% rock, as in pipes_timing, or a thousandth of that
+  // for the sparse solver.
+  auto random_grid = [&](coordinate rows, coordinate columns, bool sparse) {
+    unsigned cells = rows * columns, scale = sparse ? 1000 : 1;
+    return grid::random(rows, columns, cells / 5 / scale,
+                        cells / 10 / scale, gen);
+  };
+
+  cost_model m = defaults();
+  for (int k = 0; k < SOLVER_KIND_COUNT; ++k) {
+    auto kind = solver_kind(k);
+    bool sparse = (kind == SOLVER_SPARSE);
+    grid small = (kind == SOLVER_EXHAUSTIVE) ? random_grid(4, 6, false)
+                                             : random_grid(64, 64, sparse),
+         large = (kind == SOLVER_EXHAUSTIVE) ? random_grid(5, 15, false)
+                                             : random_grid(512, 512, sparse);
+    if (!applicable(kind, grid_features::of(large), cores) ||
+        ((kind == SOLVER_BANDS) && !use_processes)) {
+      continue;
+    }
+
+    // Best of three runs, to keep scheduling noise out of the fit.
+    auto time_ns = [&](const grid& setting) {
+      double best = std::numeric_limits<double>::max();
+      for (int repeat = 0; repeat < 3; ++repeat) {
+        auto start = clock::now();
+        econ_pipes_solve_with(setting, kind, cores);
+        best = std::min(best, double(std::chrono::duration_cast<
+                                       std::chrono::nanoseconds>(
+                                       clock::now() - start).count()));
+      }
+      return best;
+    };
+
+    auto fs = grid_features::of(small), fl = grid_features::of(large);
+    double us = work_units(kind, fs, cores), ul = work_units(kind, fl, cores);
+    double ts = time_ns(small), tl = time_ns(large);
+    double unit = std::max(0.0, (tl - ts) / (ul - us));
+    m.terms_[k] = term{std::max(0.0, ts - unit * us), unit};
+  }
+  return m;
+}
+
+// Solve the economical pipes problem with whichever solver the cost model
+// predicts is fastest for this grid.
+path econ_pipes_solve(const grid& setting,
+                      const dispatch_options& options = dispatch_options()) {
+  trace_scope trace("dispatch: choose");
+  auto model = options.model ? *options.model : cost_model::defaults();
+  auto kind = model.choose(grid_features::of(setting), options);
+  trace.next("dispatch: solve");
+  return econ_pipes_solve_with(setting, kind, options.cores);
+}
+
+}
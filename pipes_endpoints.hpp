@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_endpoints.hpp
+//
+// Economical pipes with several candidate inlets and outlets.
+//
+// Instead of always starting at (0, 0), the path may start at any of a set
+// of source cells and must end at one of a set of sink cells. All sources
+// are seeded into a single dynamic programming sweep, so finding the best
+// route over every source-sink pair costs O(rows*columns), the same as one
+// ordinary solve.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// Output of the multi-endpoint solver: the best path, and the indices into
+// the sources and sinks lists of the cells it starts and ends at.
+struct endpoint_solution {
+  path best;
+  size_t source, sink;
+};
+
+// Solve the economical pipes problem over every pair of a source and a sink.
+// The best path starts at a source, only moves right and down, avoids rocks,
+// ends at a sink, and visits the most open cells, counting the source and
+// sink themselves. Returns no solution when no sink is reachable from any
+// source.
+//
+// Sources and sinks on rock cells are ignored. Ties are broken the same way
+// as econ_pipes_dyn_prog: arriving from above beats arriving from the left,
+// and continuing a path beats starting a new one at a source. Among equally
+// good sinks, the earliest in the list wins.
+std::optional<endpoint_solution> econ_pipes_endpoints(
+    const grid& setting,
+    const std::vector<grid_position>& sources,
+    const std::vector<grid_position>& sinks) {
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+
+  trace_scope phase("endpoints: fill");
+
+  // How the best path to a cell arrived there.
+  enum arrival : uint8_t { ARRIVAL_NONE, ARRIVAL_SOURCE,
+                           ARRIVAL_ABOVE, ARRIVAL_LEFT };
+
+  std::vector<uint8_t> seeded(rows * columns, 0);
+  for (auto& p : sources) {
+    assert(setting.is_row_column(p.row, p.column));
+    seeded[p.row * columns + p.column] = 1;
+  }
+
+  // Open cells on the best path to each cell, or -1 when no source reaches
+  // it.
+  std::vector<int32_t> score(rows * columns, -1);
+  std::vector<uint8_t> how(rows * columns, ARRIVAL_NONE);
+
+  for (coordinate r = 0; r < rows; ++r) {
+    for (coordinate c = 0; c < columns; ++c) {
+      auto cell = setting.get(r, c);
+      if (cell == CELL_ROCK) {
+        continue;
+      }
+      const size_t i = r * columns + c;
+
+      int32_t best = -1;
+      uint8_t from = ARRIVAL_NONE;
+      if ((r > 0) && (score[i - columns] >= 0)) {
+        best = score[i - columns];
+        from = ARRIVAL_ABOVE;
+      }
+      if ((c > 0) && (score[i - 1] > best)) {
+        best = score[i - 1];
+        from = ARRIVAL_LEFT;
+      }
+      if (seeded[i] && (best < 0)) {
+        best = 0;
+        from = ARRIVAL_SOURCE;
+      }
+
+      if (from != ARRIVAL_NONE) {
+        score[i] = best + ((cell == CELL_OPEN) ? 1 : 0);
+        how[i] = from;
+      }
+    }
+  }
+
+  // Take the maximum over sinks.
+  std::optional<size_t> sink;
+  for (size_t k = 0; k < sinks.size(); ++k) {
+    auto& p = sinks[k];
+    assert(setting.is_row_column(p.row, p.column));
+    int32_t s = score[p.row * columns + p.column];
+    if ((s >= 0) &&
+        (!sink ||
+         (s > score[sinks[*sink].row * columns + sinks[*sink].column]))) {
+      sink = k;
+    }
+  }
+  if (!sink) {
+    return std::nullopt;
+  }
+
+  phase.next("endpoints: reconstruct path");
+
+  // Walk back to the source the winning path was seeded at.
+  std::vector<step_direction> reversed;
+  coordinate r = sinks[*sink].row, c = sinks[*sink].column;
+  while (how[r * columns + c] != ARRIVAL_SOURCE) {
+    if (how[r * columns + c] == ARRIVAL_ABOVE) {
+      reversed.push_back(STEP_DIRECTION_DOWN);
+      --r;
+    } else {
+      assert(how[r * columns + c] == ARRIVAL_LEFT);
+      reversed.push_back(STEP_DIRECTION_RIGHT);
+      --c;
+    }
+  }
+
+  size_t source = 0;
+  while (!((sources[source].row == r) && (sources[source].column == c))) {
+    ++source;
+  }
+
+  return endpoint_solution{
+    path(setting, r, c,
+         std::vector<step_direction>(reversed.rbegin(), reversed.rend())),
+    source,
+    *sink
+  };
+}
+
+}
@@ -0,0 +1,227 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_enumerate.hpp
+//
+// Lazy enumeration of the candidate paths considered by exhaustive search.
+//
+// candidate_paths walks the tree of valid paths from (0, 0) depth-first,
+// keeping one shared prefix and undoing steps on the way back up, so each
+// candidate costs O(1) amortized work to reach instead of a full rebuild.
+// Callers can stop early, sample, or stream the candidates, and only turn
+// the ones they care about into real path objects.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// Filters applied while enumerating. Subtrees that cannot produce a
+// candidate passing the filters are pruned, not just skipped.
+struct candidate_options {
+
+  // Only yield paths that visit at least this many open cells.
+  unsigned min_open = 0;
+
+  // When fixed_endpoint is true, only yield paths ending at
+  // (end_row, end_column).
+  bool fixed_endpoint = false;
+  coordinate end_row = 0, end_column = 0;
+};
+
+// Generator over every valid path that starts at (0, 0) and passes the
+// given options, including paths that stop before the bottom-right corner.
+// Paths are yielded in pre-order: a path comes before its extensions, and
+// extensions to the right come before extensions downward.
+//
+// Usage:
+//
+//    pipes::candidate_paths candidates(setting);
+//    while (candidates.next()) {
+//      if (candidates.total_open() > best) { ... candidates.to_path() ... }
+//    }
+//
+// or with a range-based for loop, where each element is the generator
+// itself positioned at the current candidate.
+//
+// The grid must outlive the generator.
+class candidate_paths {
+private:
+
+  // Progress through the children of one node in the path tree.
+  enum frame_state { FRAME_VISIT, FRAME_RIGHT, FRAME_DOWN, FRAME_DONE };
+
+  const grid* setting_;
+  candidate_options options_;
+  coordinate last_row_, last_column_;
+
+  // The shared prefix: steps after STEP_DIRECTION_START, and one frame per
+  // node on the way down, so frames_.size() == steps_.size() + 1 until the
+  // walk finishes.
+  std::vector<step_direction> steps_;
+  std::vector<frame_state> frames_;
+  coordinate final_row_, final_column_;
+  unsigned total_open_;
+
+  // Return true if stepping in the given direction stays on the grid, avoids
+  // rocks, and can still lead to a candidate passing the filters.
+  bool may_descend(step_direction dir) const {
+    coordinate row = final_row_ + step(dir).delta_row(),
+               column = final_column_ + step(dir).delta_column();
+    if ((row > last_row_) || (column > last_column_) ||
+        !setting_->may_step(row, column)) {
+      return false;
+    }
+    // Optimistic bound: every remaining step lands on an open cell.
+    unsigned open = total_open_ +
+                    ((setting_->get(row, column) == CELL_OPEN) ? 1 : 0);
+    coordinate remaining = (last_row_ - row) + (last_column_ - column);
+    return (open + remaining >= options_.min_open);
+  }
+
+  bool accepts() const {
+    return ((total_open_ >= options_.min_open) &&
+            (!options_.fixed_endpoint ||
+             ((final_row_ == options_.end_row) &&
+              (final_column_ == options_.end_column))));
+  }
+
+  void push(step_direction dir) {
+    steps_.push_back(dir);
+    final_row_ += step(dir).delta_row();
+    final_column_ += step(dir).delta_column();
+    if (setting_->get(final_row_, final_column_) == CELL_OPEN) {
+      ++total_open_;
+    }
+    frames_.push_back(FRAME_VISIT);
+  }
+
+  void pop() {
+    frames_.pop_back();
+    if (frames_.empty()) {
+      return;
+    }
+    if (setting_->get(final_row_, final_column_) == CELL_OPEN) {
+      --total_open_;
+    }
+    step last(steps_.back());
+    final_row_ -= last.delta_row();
+    final_column_ -= last.delta_column();
+    steps_.pop_back();
+  }
+
+public:
+
+  // Create a generator positioned before the first candidate.
+  candidate_paths(const grid& setting,
+                  const candidate_options& options = candidate_options())
+  : setting_(&setting),
+    options_(options),
+    last_row_(setting.rows() - 1),
+    last_column_(setting.columns() - 1),
+    frames_{FRAME_VISIT},
+    final_row_(0),
+    final_column_(0),
+    total_open_(0) {
+
+    if (options_.fixed_endpoint) {
+      assert(setting.is_row_column(options_.end_row, options_.end_column));
+      last_row_ = options_.end_row;
+      last_column_ = options_.end_column;
+    }
+    steps_.reserve(last_row_ + last_column_);
+    frames_.reserve(last_row_ + last_column_ + 1);
+  }
+
+  // Advance to the next candidate. Returns false, and leaves the generator
+  // exhausted, when there are no more.
+  bool next() {
+    while (!frames_.empty()) {
+      auto& state = frames_.back();
+      switch (state) {
+      case FRAME_VISIT:
+        state = FRAME_RIGHT;
+        if (accepts()) {
+          return true;
+        }
+        break;
+      case FRAME_RIGHT:
+        state = FRAME_DOWN;
+        if (may_descend(STEP_DIRECTION_RIGHT)) {
+          push(STEP_DIRECTION_RIGHT);
+        }
+        break;
+      case FRAME_DOWN:
+        state = FRAME_DONE;
+        if (may_descend(STEP_DIRECTION_DOWN)) {
+          push(STEP_DIRECTION_DOWN);
+        }
+        break;
+      case FRAME_DONE:
+        pop();
+        break;
+      }
+    }
+    return false;
+  }
+
+  // Return true once next() has returned false.
+  bool done() const { return frames_.empty(); }
+
+  // Accessors for the current candidate; only meaningful after next()
+  // returned true. steps() excludes the STEP_DIRECTION_START step.
+  const grid& setting() const { return *setting_; }
+  const std::vector<step_direction>& steps() const { return steps_; }
+  coordinate final_row() const { return final_row_; }
+  coordinate final_column() const { return final_column_; }
+  unsigned total_open() const { return total_open_; }
+
+  // Materialize the current candidate.
+  path to_path() const { return path(*setting_, steps_); }
+
+  // Input iterator over the candidates, for range-based for loops.
+  class iterator {
+  private:
+    candidate_paths* generator_;
+
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = candidate_paths;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const candidate_paths*;
+    using reference = const candidate_paths&;
+
+    iterator(candidate_paths* generator)
+    : generator_(generator) {
+      if (generator_ && !generator_->next()) {
+        generator_ = nullptr;
+      }
+    }
+
+    reference operator*() const { return *generator_; }
+    pointer operator->() const { return generator_; }
+
+    iterator& operator++() {
+      if (!generator_->next()) {
+        generator_ = nullptr;
+      }
+      return *this;
+    }
+
+    bool operator==(const iterator& o) const {
+      return generator_ == o.generator_;
+    }
+    bool operator!=(const iterator& o) const { return !(*this == o); }
+  };
+
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(nullptr); }
+};
+
+}
@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_io.hpp
+//
+// Blocking reads and writes of whole buffers on POSIX file descriptors, for
+// talking to worker processes and daemon clients over pipes and sockets.
+//
+// Failures are reported by throwing std::system_error.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <system_error>
+
+#include <unistd.h>
+
+namespace pipes {
+
+// Write exactly size bytes, retrying after partial writes and signals.
+void write_all(int fd, const void* data, size_t size) {
+  auto* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "write");
+    }
+    p += n;
+    size -= size_t(n);
+  }
+}
+
+// Read up to size bytes, stopping early only at end of file. Returns the
+// number of bytes read.
+size_t read_up_to(int fd, void* data, size_t size) {
+  auto* p = static_cast<char*>(data);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::read(fd, p + done, size - done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "read");
+    }
+    if (n == 0) {
+      break;
+    }
+    done += size_t(n);
+  }
+  return done;
+}
+
+// Read exactly size bytes. Reaching end of file first is an error.
+void read_all(int fd, void* data, size_t size) {
+  if (read_up_to(fd, data, size) != size) {
+    throw std::system_error(EPIPE, std::generic_category(),
+                            "unexpected end of file");
+  }
+}
+
+}
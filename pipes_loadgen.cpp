@@ -0,0 +1,256 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_loadgen.cpp
+//
+// Load generator for pipes_daemon.
+//
+// Usage:
+//
+//    pipes_loadgen --socket PATH [--clients C] [--window W]
+//                  [--requests N] [--size S]
+//
+// Opens C connections to the daemon, each on its own thread, and sends N
+// random S-by-S grids down each, keeping up to W requests in flight per
+// connection, at most pipes::MAX_IN_FLIGHT. Reports requests per second,
+// client-side latency percentiles, and the daemon's own counters.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "pipes_protocol.hpp"
+
+using clock_type = std::chrono::steady_clock;
+
+struct loadgen_options {
+  std::string socket_path;
+  unsigned clients = 4, window = 8, requests = 1000;
+  pipes::coordinate size = 64;
+};
+
+int connect_to(const std::string& socket_path) {
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_path.c_str(),
+               sizeof(address.sun_path) - 1);
+  if ((fd < 0) ||
+      (::connect(fd, reinterpret_cast<sockaddr*>(&address),
+                 sizeof(address)) < 0)) {
+    throw std::system_error(errno, std::generic_category(),
+                            "connect " + socket_path);
+  }
+  return fd;
+}
+
+// What one client saw: the latency of each answered request in
+// nanoseconds, and how many responses were errors or had ids it never sent.
+struct client_result {
+  std::vector<uint64_t> latencies;
+  uint64_t errors = 0;
+};
+
+client_result run_client(const loadgen_options& options, unsigned seed) {
+
+  // Encode a handful of grids up front so the client measures the daemon,
+  // not grid generation.
+  std::mt19937 gen(seed);
+  unsigned cells = options.size * options.size;
+  std::vector<pipes::solve_request> grids;
+  for (unsigned i = 0; i < 16; ++i) {
+    grids.push_back(pipes::solve_request::from_grid(
+      0, pipes::grid::random(options.size, options.size,
+                             cells / 5, cells / 10, gen)));
+  }
+
+  int fd = connect_to(options.socket_path);
+  std::unordered_map<uint64_t, clock_type::time_point> sent;
+  client_result result;
+  result.latencies.reserve(options.requests);
+
+  uint64_t next_id = 0;
+  auto send_one = [&]() {
+    auto& request = grids[next_id % grids.size()];
+    request.id = next_id;
+    sent[next_id] = clock_type::now();
+    pipes::write_frame(fd, pipes::encode(request));
+    ++next_id;
+  };
+
+  while ((next_id < options.requests) && (next_id < options.window)) {
+    send_one();
+  }
+
+  std::vector<uint8_t> payload;
+  pipes::solve_response response;
+  for (unsigned answered = 0; answered < options.requests; ++answered) {
+    if (!pipes::read_frame(fd, payload) ||
+        !pipes::decode(payload, response)) {
+      throw std::runtime_error("bad response from daemon");
+    }
+    auto it = sent.find(response.id);
+    if (it == sent.end()) {
+      ++result.errors;
+      continue;
+    }
+    if (response.status != pipes::RESPONSE_OK) {
+      ++result.errors;
+    }
+    result.latencies.push_back(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now() - it->second).count());
+    sent.erase(it);
+    if (next_id < options.requests) {
+      send_one();
+    }
+  }
+
+  ::close(fd);
+  return result;
+}
+
+pipes::daemon_stats query_stats(const std::string& socket_path) {
+  int fd = connect_to(socket_path);
+  pipes::write_frame(fd, pipes::encode_stats_request());
+  std::vector<uint8_t> payload;
+  pipes::daemon_stats stats;
+  if (!pipes::read_frame(fd, payload) || !pipes::decode(payload, stats)) {
+    throw std::runtime_error("bad stats response from daemon");
+  }
+  ::close(fd);
+  return stats;
+}
+
+// Parse a whole decimal argument between 1 and max.
+bool parse_count(const std::string& text, unsigned long max,
+                 unsigned& value) {
+  char* end;
+  errno = 0;
+  long parsed = std::strtol(text.c_str(), &end, 10);
+  if (text.empty() || (*end != '\0') || (errno == ERANGE) ||
+      (parsed < 1) || (static_cast<unsigned long>(parsed) > max)) {
+    return false;
+  }
+  value = unsigned(parsed);
+  return true;
+}
+
+void usage() {
+  std::cerr << "usage: pipes_loadgen --socket PATH [--clients C] "
+            << "[--window W] [--requests N] [--size S]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+  loadgen_options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 == argc) {
+      usage();
+      return 1;
+    }
+    std::string value = argv[++i];
+    unsigned size;
+    bool ok = true;
+    if (arg == "--socket") {
+      options.socket_path = value;
+    } else if (arg == "--clients") {
+      ok = parse_count(value, 1024, options.clients);
+    } else if (arg == "--window") {
+      ok = parse_count(value, UINT_MAX, options.window);
+    } else if (arg == "--requests") {
+      ok = parse_count(value, UINT_MAX, options.requests);
+    } else if (arg == "--size") {
+      ok = parse_count(value, 65535, size);
+      options.size = size;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      usage();
+      return 1;
+    }
+  }
+  if (options.socket_path.empty()) {
+    usage();
+    return 1;
+  }
+  options.window = std::min<unsigned>(options.window, pipes::MAX_IN_FLIGHT);
+
+  std::vector<client_result> per_client(options.clients);
+  std::vector<std::thread> threads;
+  std::atomic<bool> failed(false);
+  auto start = clock_type::now();
+  for (unsigned i = 0; i < options.clients; ++i) {
+    threads.emplace_back([&, i]() {
+      try {
+        per_client[i] = run_client(options, i + 1);
+      } catch (const std::exception& e) {
+        std::cerr << "pipes_loadgen: " << e.what() << std::endl;
+        failed = true;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  double seconds = std::chrono::duration<double>(clock_type::now() -
+                                                 start).count();
+  if (failed) {
+    return 1;
+  }
+
+  std::vector<uint64_t> latencies;
+  uint64_t errors = 0;
+  for (auto& result : per_client) {
+    latencies.insert(latencies.end(), result.latencies.begin(),
+                     result.latencies.end());
+    errors += result.errors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double fraction) {
+    if (latencies.empty()) {
+      return 0.0;
+    }
+    return latencies[size_t(fraction * (latencies.size() - 1))] / 1000.0;
+  };
+
+  std::cout << "clients=" << options.clients
+            << ", window=" << options.window
+            << ", size=" << options.size << "x" << options.size
+            << std::endl
+            << "requests: " << latencies.size()
+            << " in " << seconds << " s = "
+            << (latencies.size() / seconds) << " req/s, "
+            << errors << " errors" << std::endl
+            << "client latency us: p50=" << percentile(0.50)
+            << " p99=" << percentile(0.99)
+            << " max=" << percentile(1.0) << std::endl;
+
+  auto stats = query_stats(options.socket_path);
+  std::cout << "daemon: requests=" << stats.requests
+            << " errors=" << stats.errors
+            << " uptime_s=" << (stats.uptime_ns / 1e9)
+            << " mean_us="
+            << (stats.requests ? stats.total_latency_ns / 1e3 /
+                                 stats.requests : 0.0)
+            << " p50_us<=" << (stats.p50_latency_ns / 1e3)
+            << " p99_us<=" << (stats.p99_latency_ns / 1e3)
+            << " max_us=" << (stats.max_latency_ns / 1e3) << std::endl;
+  return errors ? 1 : 0;
+}
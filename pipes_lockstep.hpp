@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_lockstep.hpp
+//
+// Solve many small grids of the same shape at once, one grid per lane.
+//
+// Tiny grids give a per-grid DP too little work to keep vector units busy.
+// Here up to 32 grids are interleaved in a structure-of-arrays layout: for
+// every cell, the 32 grids' values for that cell sit next to each other in
+// memory. The DP recurrence then runs once per cell for all lanes, as a
+// loop over lanes with no branches that the compiler can turn into vector
+// instructions. Scores are uint8_t, stored plus one as in pipes_narrow.hpp,
+// and each lane records one byte per cell saying whether its best path
+// arrived from the left. Each grid's path is rebuilt from its lane's bytes
+// afterwards.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "pipes_narrow.hpp"
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+namespace lockstep_detail {
+
+// Grids solved together.
+const size_t LANES = 32;
+
+// Scratch space for one batch, reused across batches.
+struct batch_tables {
+  // Per cell, then per lane: 0xFF if the cell is not rock, 0 if it is;
+  // 1 if the cell is open, 0 otherwise; 1 if the best path arrived from
+  // the left.
+  std::vector<uint8_t> passable, gain, from_left;
+
+  // Per column, then per lane: the score of the row being filled.
+  std::vector<uint8_t> scores;
+};
+
+// Fill one cell for every lane, updating the row scores above and left in
+// place. Written with masks rather than branches, and with no pointers
+// overlapping, so that it vectorizes.
+inline void fill_cell(uint8_t* __restrict__ above, uint8_t* __restrict__ left,
+                      const uint8_t* __restrict__ passable,
+                      const uint8_t* __restrict__ gain,
+                      uint8_t* __restrict__ from_left,
+                      uint8_t* __restrict__ best,
+                      uint16_t* __restrict__ best_cell, uint16_t cell) {
+  for (size_t l = 0; l < LANES; ++l) {
+    uint8_t a = above[l], b = left[l];
+    uint8_t take_left = -uint8_t(b > a);
+    uint8_t from = std::max(a, b);
+    uint8_t reached = -uint8_t(from != 0);
+    uint8_t score = uint8_t(from + gain[l]) & reached & passable[l];
+    above[l] = score;
+    left[l] = score;
+    from_left[l] = take_left & 1;
+    uint16_t better = -uint16_t((score != 0) & (score >= best[l]));
+    best[l] = std::max(best[l], score);
+    best_cell[l] = uint16_t((better & cell) | (~better & best_cell[l]));
+  }
+}
+
+// Solve settings[first, first + count), which all have the given shape,
+// into out[first, first + count).
+void solve_batch(const std::vector<grid>& settings, size_t first,
+                 size_t count, coordinate rows, coordinate columns,
+                 batch_tables& tables, std::vector<solution_steps>& out) {
+
+  const size_t L = LANES, cells = rows * columns;
+
+  // Lanes past count repeat the first grid, and are ignored.
+  tables.passable.resize(cells * L);
+  tables.gain.resize(cells * L);
+  tables.from_left.resize(cells * L);
+  for (size_t l = 0; l < L; ++l) {
+    const grid& setting = settings[first + ((l < count) ? l : 0)];
+    assert((setting.rows() == rows) && (setting.columns() == columns));
+    for (coordinate r = 0; r < rows; ++r) {
+      for (coordinate c = 0; c < columns; ++c) {
+        auto cell = setting.get(r, c);
+        size_t i = (r * columns + c) * L + l;
+        tables.passable[i] = (cell == CELL_ROCK) ? 0 : 0xFF;
+        tables.gain[i] = (cell == CELL_OPEN) ? 1 : 0;
+      }
+    }
+  }
+
+  // The start is reached as if from a cell above it scoring 1.
+  tables.scores.assign(columns * L, 0);
+  std::fill(tables.scores.begin(), tables.scores.begin() + L, 1);
+
+  // Keep the last best cell in row-major order.
+  uint8_t best[L] = {}, left[L];
+  uint16_t best_cell[L] = {};
+
+  for (coordinate r = 0; r < rows; ++r) {
+    std::fill(left, left + L, 0);
+    for (coordinate c = 0; c < columns; ++c) {
+      const size_t i = r * columns + c;
+      fill_cell(&tables.scores[c * L], left, &tables.passable[i * L],
+                &tables.gain[i * L], &tables.from_left[i * L], best,
+                best_cell, uint16_t(i));
+    }
+  }
+
+  // Arriving from above wins unless left is strictly better, as in
+  // econ_pipes_dyn_prog.
+  for (size_t l = 0; l < count; ++l) {
+    assert(best[l] > 0);
+    solution_steps& result = out[first + l];
+    result.final_row = best_cell[l] / columns;
+    result.final_column = best_cell[l] % columns;
+    result.total_open = unsigned(best[l]) - 1;
+    result.steps.clear();
+    for (coordinate r = result.final_row, c = result.final_column;
+         (r > 0) || (c > 0); ) {
+      if (tables.from_left[(r * columns + c) * L + l]) {
+        result.steps.push_back(STEP_DIRECTION_RIGHT);
+        --c;
+      } else {
+        result.steps.push_back(STEP_DIRECTION_DOWN);
+        --r;
+      }
+    }
+    std::reverse(result.steps.begin(), result.steps.end());
+  }
+}
+
+}
+
+// Solve every grid in settings, 32 at a time. The results are in the same
+// order as settings, and identical to econ_pipes_dyn_prog for each grid.
+//
+// All grids must have the same shape, with rows + columns < 256.
+std::vector<solution_steps> econ_pipes_lockstep(
+    const std::vector<grid>& settings) {
+
+  std::vector<solution_steps> out(settings.size());
+  if (settings.empty()) {
+    return out;
+  }
+
+  const coordinate rows = settings[0].rows(), columns = settings[0].columns();
+  assert(score_type_fits<uint8_t>(rows, columns));
+
+  trace_scope trace("lockstep: solve");
+
+  lockstep_detail::batch_tables tables;
+  for (size_t first = 0; first < settings.size();
+       first += lockstep_detail::LANES) {
+    lockstep_detail::solve_batch(
+      settings, first,
+      std::min(lockstep_detail::LANES, settings.size() - first),
+      rows, columns, tables, out);
+  }
+  return out;
+}
+
+}
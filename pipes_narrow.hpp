@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_narrow.hpp
+//
+// A dynamic programming solver whose score table uses the narrowest integer
+// type that can hold any score for the grid's dimensions.
+//
+// A path visits at most rows+columns-1 cells, so no score exceeds that.
+// Each cell stores its score plus one, with zero meaning unreachable, so
+// scores fit in uint8_t when rows+columns < 256 and in uint16_t when
+// rows+columns < 65536. The fill is a template over the score type, giving
+// each width its own instantiation; econ_pipes_narrow picks one at run
+// time. The table also replaces the per-cell direction flags, since the
+// path can be walked back by comparing the scores of neighbouring cells.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// Return true if Score can hold every score for a grid of this size.
+template <typename Score>
+bool score_type_fits(coordinate rows, coordinate columns) {
+  return rows + columns <= std::numeric_limits<Score>::max();
+}
+
+// Solve using a table of Score. Paths, including how ties are broken, are
+// identical to econ_pipes_dyn_prog.
+//
+// The grid must be non-empty, and score_type_fits<Score> must hold.
+template <typename Score>
+solution_steps econ_pipes_narrow_as(const grid& setting) {
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  assert(rows > 0);
+  assert(columns > 0);
+  assert(score_type_fits<Score>(rows, columns));
+
+  trace_scope phase("narrow: fill");
+
+  // table[r * columns + c] is one more than the open cells on the best path
+  // to (r, c), or zero when (r, c) is unreachable.
+  std::vector<Score> table(rows * columns, 0);
+
+  // Keep the last best cell in row-major order.
+  Score best = 0;
+  coordinate best_row = 0, best_column = 0;
+
+  for (coordinate r = 0; r < rows; ++r) {
+    Score* here = &table[r * columns];
+    const Score* above = (r > 0) ? here - columns : nullptr;
+    Score left = 0;
+    for (coordinate c = 0; c < columns; ++c) {
+      auto cell = setting.get(r, c);
+      // The start cell is reachable with no cells before it.
+      Score from = ((r == 0) && (c == 0))
+                   ? Score(1)
+                   : std::max<Score>(above ? above[c] : Score(0), left);
+      left = ((cell == CELL_ROCK) || (from == 0))
+             ? Score(0)
+             : Score(from + ((cell == CELL_OPEN) ? 1 : 0));
+      here[c] = left;
+      if ((left != 0) && (left >= best)) {
+        best = left;
+        best_row = r;
+        best_column = c;
+      }
+    }
+  }
+  assert(best > 0);
+
+  phase.next("narrow: reconstruct path");
+
+  // Arriving from above wins unless the left neighbour is strictly better,
+  // as in the fill.
+  solution_steps result;
+  result.final_row = best_row;
+  result.final_column = best_column;
+  result.total_open = unsigned(best) - 1;
+  for (coordinate r = best_row, c = best_column; (r > 0) || (c > 0); ) {
+    Score above = (r > 0) ? table[(r - 1) * columns + c] : Score(0),
+          left = (c > 0) ? table[r * columns + c - 1] : Score(0);
+    if (left > above) {
+      result.steps.push_back(STEP_DIRECTION_RIGHT);
+      --c;
+    } else {
+      result.steps.push_back(STEP_DIRECTION_DOWN);
+      --r;
+    }
+  }
+  std::reverse(result.steps.begin(), result.steps.end());
+  return result;
+}
+
+// Solve using the narrowest score table that fits the grid.
+solution_steps econ_pipes_narrow(const grid& setting) {
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  if (score_type_fits<uint8_t>(rows, columns)) {
+    return econ_pipes_narrow_as<uint8_t>(setting);
+  } else if (score_type_fits<uint16_t>(rows, columns)) {
+    return econ_pipes_narrow_as<uint16_t>(setting);
+  } else if (score_type_fits<uint32_t>(rows, columns)) {
+    return econ_pipes_narrow_as<uint32_t>(setting);
+  } else {
+    return econ_pipes_narrow_as<uint64_t>(setting);
+  }
+}
+
+}
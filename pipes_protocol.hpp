@@ -0,0 +1,355 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_protocol.hpp
+//
+// Binary framing used between pipes_daemon and its clients.
+//
+// Every message is a frame: a 32-bit payload length, then the payload,
+// which starts with a 32-bit message kind. Integers are in host byte order,
+// since both ends run on the same machine.
+//
+//   MESSAGE_SOLVE request:   id (64), rows (32), columns (32),
+//                            cells packed 2 bits each, row-major
+//   MESSAGE_SOLVE response:  id (64), status (32), total_open (32),
+//                            step count (64), steps packed 1 bit each
+//                            (1 = right, 0 = down) after the start
+//   MESSAGE_STATS request:   nothing more
+//   MESSAGE_STATS response:  a daemon_stats, one 64-bit field at a time
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "pipes_io.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+enum message_kind : uint32_t {
+  MESSAGE_SOLVE = 1,
+  MESSAGE_STATS = 2
+};
+
+enum response_status : uint32_t {
+  RESPONSE_OK = 0,
+  RESPONSE_MALFORMED = 1
+};
+
+// Requests a client may send before reading any responses. The daemon
+// stops reading from a client with this many requests unanswered, so a
+// client that sends more without reading can deadlock with it.
+const size_t MAX_IN_FLIGHT = 64;
+
+// Largest grid, in cells, that pipes_daemon solves unless told otherwise.
+// Solving takes a few bytes per cell, kept by every solver thread.
+const size_t DEFAULT_MAX_CELLS = size_t(1) << 24;
+
+// Payload bytes of a MESSAGE_SOLVE request for a grid of this many cells.
+constexpr size_t solve_request_bytes(size_t cells) {
+  return 4 + 8 + 4 + 4 + (cells + 3) / 4;
+}
+
+// Frames larger than this are not read into memory by default: enough for
+// a request at DEFAULT_MAX_CELLS.
+const size_t MAX_FRAME_BYTES = solve_request_bytes(DEFAULT_MAX_CELLS);
+
+// A grid to solve, with its cells packed 2 bits each, 4 per byte.
+struct solve_request {
+  uint64_t id = 0;
+  coordinate rows = 0, columns = 0;
+  std::vector<uint8_t> cells;
+
+  static solve_request from_grid(uint64_t id, const grid& setting) {
+    solve_request result;
+    result.id = id;
+    result.rows = setting.rows();
+    result.columns = setting.columns();
+    result.cells.assign((result.rows * result.columns + 3) / 4, 0);
+    for (coordinate r = 0; r < result.rows; ++r) {
+      for (coordinate c = 0; c < result.columns; ++c) {
+        size_t i = r * result.columns + c;
+        result.cells[i / 4] |= uint8_t(setting.get(r, c)) << (2 * (i % 4));
+      }
+    }
+    return result;
+  }
+
+  cell_kind get(coordinate row, coordinate column) const {
+    size_t i = row * columns + column;
+    return cell_kind((cells[i / 4] >> (2 * (i % 4))) & 3);
+  }
+
+  // Return true if the dimensions and cells describe a valid grid of at
+  // most max_cells cells.
+  bool valid(size_t max_cells = DEFAULT_MAX_CELLS) const {
+    if ((rows == 0) || (columns == 0) || (rows * columns > max_cells) ||
+        (cells.size() != (rows * columns + 3) / 4) ||
+        (get(0, 0) != CELL_SOIL)) {
+      return false;
+    }
+    for (coordinate r = 0; r < rows; ++r) {
+      for (coordinate c = 0; c < columns; ++c) {
+        if (get(r, c) > CELL_OPEN) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+};
+
+// The answer to one solve_request.
+struct solve_response {
+  uint64_t id = 0;
+  uint32_t status = RESPONSE_OK;
+  uint32_t total_open = 0;
+  uint64_t length = 0;
+  std::vector<uint8_t> steps;
+
+  void set_steps(const std::vector<step_direction>& directions) {
+    length = directions.size();
+    steps.assign((length + 7) / 8, 0);
+    for (size_t i = 0; i < length; ++i) {
+      if (directions[i] == STEP_DIRECTION_RIGHT) {
+        steps[i / 8] |= uint8_t(1) << (i % 8);
+      }
+    }
+  }
+
+  std::vector<step_direction> directions() const {
+    std::vector<step_direction> result(length);
+    for (size_t i = 0; i < length; ++i) {
+      result[i] = ((steps[i / 8] >> (i % 8)) & 1) ? STEP_DIRECTION_RIGHT
+                                                  : STEP_DIRECTION_DOWN;
+    }
+    return result;
+  }
+};
+
+// Throughput and latency counters kept by the daemon. Latencies run from
+// when a request is decoded to when its response is encoded; percentiles
+// are rounded up to a power of two nanoseconds.
+struct daemon_stats {
+  uint64_t requests = 0, errors = 0;
+  uint64_t uptime_ns = 0;
+  uint64_t total_latency_ns = 0, max_latency_ns = 0;
+  uint64_t p50_latency_ns = 0, p99_latency_ns = 0;
+};
+
+namespace protocol_detail {
+
+// Appends fixed-size values to a payload.
+class writer {
+private:
+  std::vector<uint8_t>& out_;
+
+public:
+  writer(std::vector<uint8_t>& out) : out_(out) { }
+
+  template <typename T>
+  void put(T value) {
+    auto at = out_.size();
+    out_.resize(at + sizeof(T));
+    std::memcpy(&out_[at], &value, sizeof(T));
+  }
+
+  void put_bytes(const std::vector<uint8_t>& bytes) {
+    out_.insert(out_.end(), bytes.begin(), bytes.end());
+  }
+};
+
+// Consumes fixed-size values from a payload, remembering whether it ran
+// past the end.
+class reader {
+private:
+  const std::vector<uint8_t>& in_;
+  size_t at_ = 0;
+  bool ok_ = true;
+
+public:
+  reader(const std::vector<uint8_t>& in) : in_(in) { }
+
+  bool ok() const { return ok_; }
+  bool at_end() const { return at_ == in_.size(); }
+
+  template <typename T>
+  T get() {
+    T value{};
+    if (at_ + sizeof(T) > in_.size()) {
+      ok_ = false;
+      return value;
+    }
+    std::memcpy(&value, &in_[at_], sizeof(T));
+    at_ += sizeof(T);
+    return value;
+  }
+
+  std::vector<uint8_t> get_bytes(size_t n) {
+    if ((n > in_.size()) || (at_ + n > in_.size())) {
+      ok_ = false;
+      return {};
+    }
+    std::vector<uint8_t> result(in_.begin() + at_, in_.begin() + at_ + n);
+    at_ += n;
+    return result;
+  }
+};
+
+}
+
+// Encode messages as payloads, without the length prefix.
+std::vector<uint8_t> encode(const solve_request& request) {
+  std::vector<uint8_t> out;
+  protocol_detail::writer w(out);
+  w.put<uint32_t>(MESSAGE_SOLVE);
+  w.put<uint64_t>(request.id);
+  w.put<uint32_t>(uint32_t(request.rows));
+  w.put<uint32_t>(uint32_t(request.columns));
+  w.put_bytes(request.cells);
+  return out;
+}
+
+std::vector<uint8_t> encode(const solve_response& response) {
+  std::vector<uint8_t> out;
+  protocol_detail::writer w(out);
+  w.put<uint32_t>(MESSAGE_SOLVE);
+  w.put<uint64_t>(response.id);
+  w.put<uint32_t>(response.status);
+  w.put<uint32_t>(response.total_open);
+  w.put<uint64_t>(response.length);
+  w.put_bytes(response.steps);
+  return out;
+}
+
+std::vector<uint8_t> encode(const daemon_stats& stats) {
+  std::vector<uint8_t> out;
+  protocol_detail::writer w(out);
+  w.put<uint32_t>(MESSAGE_STATS);
+  for (uint64_t field : {stats.requests, stats.errors, stats.uptime_ns,
+                         stats.total_latency_ns, stats.max_latency_ns,
+                         stats.p50_latency_ns, stats.p99_latency_ns}) {
+    w.put<uint64_t>(field);
+  }
+  return out;
+}
+
+std::vector<uint8_t> encode_stats_request() {
+  std::vector<uint8_t> out;
+  protocol_detail::writer(out).put<uint32_t>(MESSAGE_STATS);
+  return out;
+}
+
+// Return the kind of message a payload holds, or 0 if it is too short.
+uint32_t message_kind_of(const std::vector<uint8_t>& payload) {
+  return protocol_detail::reader(payload).get<uint32_t>();
+}
+
+// Return the id of a MESSAGE_SOLVE payload, which need only hold the start
+// of the message, or 0 if it is too short.
+uint64_t request_id_of(const std::vector<uint8_t>& payload) {
+  protocol_detail::reader r(payload);
+  r.get<uint32_t>();
+  return r.get<uint64_t>();
+}
+
+// Decode payloads. Each returns false if the payload is malformed.
+bool decode(const std::vector<uint8_t>& payload, solve_request& request) {
+  protocol_detail::reader r(payload);
+  if (r.get<uint32_t>() != MESSAGE_SOLVE) {
+    return false;
+  }
+  request.id = r.get<uint64_t>();
+  request.rows = r.get<uint32_t>();
+  request.columns = r.get<uint32_t>();
+  request.cells = r.get_bytes((request.rows * request.columns + 3) / 4);
+  return r.ok() && r.at_end();
+}
+
+bool decode(const std::vector<uint8_t>& payload, solve_response& response) {
+  protocol_detail::reader r(payload);
+  if (r.get<uint32_t>() != MESSAGE_SOLVE) {
+    return false;
+  }
+  response.id = r.get<uint64_t>();
+  response.status = r.get<uint32_t>();
+  response.total_open = r.get<uint32_t>();
+  response.length = r.get<uint64_t>();
+  response.steps = r.get_bytes((response.length + 7) / 8);
+  return r.ok() && r.at_end();
+}
+
+bool decode(const std::vector<uint8_t>& payload, daemon_stats& stats) {
+  protocol_detail::reader r(payload);
+  if (r.get<uint32_t>() != MESSAGE_STATS) {
+    return false;
+  }
+  for (uint64_t* field : {&stats.requests, &stats.errors, &stats.uptime_ns,
+                          &stats.total_latency_ns, &stats.max_latency_ns,
+                          &stats.p50_latency_ns, &stats.p99_latency_ns}) {
+    *field = r.get<uint64_t>();
+  }
+  return r.ok() && r.at_end();
+}
+
+// Write one frame. Its length must fit the 32-bit length field; the
+// reader may still refuse it as too large.
+void write_frame(int fd, const std::vector<uint8_t>& payload) {
+  assert(payload.size() <= UINT32_MAX);
+  uint32_t length = uint32_t(payload.size());
+  write_all(fd, &length, sizeof(length));
+  write_all(fd, payload.data(), payload.size());
+}
+
+// Bytes of an oversized frame that read_frame keeps: the message kind and,
+// for a request, its id.
+const size_t OVERSIZED_PREFIX = 4 + 8;
+
+// Read one frame. Returns false at a clean end of file between frames;
+// throws std::system_error on a truncated frame.
+//
+// A frame longer than max_bytes is not stored. If oversized is null that
+// throws too; otherwise the frame is read and discarded, payload is left
+// holding just its first OVERSIZED_PREFIX bytes, so the sender can still be
+// answered, and *oversized is set.
+bool read_frame(int fd, std::vector<uint8_t>& payload,
+                size_t max_bytes = MAX_FRAME_BYTES,
+                bool* oversized = nullptr) {
+  uint32_t length;
+  size_t got = read_up_to(fd, &length, sizeof(length));
+  if (got == 0) {
+    return false;
+  }
+  if (got != sizeof(length)) {
+    throw std::system_error(EPIPE, std::generic_category(),
+                            "truncated frame header");
+  }
+  if (oversized) {
+    *oversized = (length > max_bytes);
+  }
+  if (length <= max_bytes) {
+    payload.resize(length);
+    read_all(fd, payload.data(), length);
+    return true;
+  }
+  if (!oversized) {
+    throw std::system_error(EMSGSIZE, std::generic_category(),
+                            "frame too large");
+  }
+
+  payload.resize(std::min<size_t>(length, OVERSIZED_PREFIX));
+  read_all(fd, payload.data(), payload.size());
+  uint8_t discard[4096];
+  for (size_t left = length - payload.size(); left > 0; ) {
+    size_t n = std::min(left, sizeof(discard));
+    read_all(fd, discard, n);
+    left -= n;
+  }
+  return true;
+}
+
+}
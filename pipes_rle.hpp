@@ -0,0 +1,322 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_rle.hpp
+//
+// A run-length-encoded grid, and a dynamic programming solver that works a
+// run at a time instead of a cell at a time.
+//
+// Each row is stored as runs of (kind, length). The solver represents each
+// row of DP scores as a piecewise linear function of the column, where every
+// piece is either constant or rises by one per column. A soil run turns the
+// row above into a running maximum, and an open run into a running maximum
+// plus one per cell; both keep the pieces in that form, so a row costs time
+// proportional to its runs plus the pieces of the row above, not to its
+// width.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// Type for a run of identical cells within one row.
+struct cell_run {
+  cell_kind kind;
+  coordinate length;
+};
+
+// A grid stored as runs of identical cells in each row.
+class rle_grid {
+private:
+  coordinate rows_, columns_;
+  std::vector<std::vector<cell_run>> runs_;
+
+public:
+
+  // Create a grid with the given number of rows and columns, all initialized
+  // to hold CELL_SOIL.
+  rle_grid(coordinate rows, coordinate columns)
+  : rows_(rows), columns_(columns),
+    runs_(rows, std::vector<cell_run>{{CELL_SOIL, columns}}) {
+
+    assert(rows > 0);
+    assert(columns > 0);
+  }
+
+  // Create a run-length-encoded copy of a dense grid.
+  static rle_grid from_grid(const grid& setting) {
+    rle_grid result(setting.rows(), setting.columns());
+    for (coordinate r = 0; r < setting.rows(); ++r) {
+      auto& runs = result.runs_[r];
+      runs.clear();
+      for (coordinate c = 0; c < setting.columns(); ++c) {
+        auto kind = setting.get(r, c);
+        if (!runs.empty() && (runs.back().kind == kind)) {
+          ++runs.back().length;
+        } else {
+          runs.push_back(cell_run{kind, 1});
+        }
+      }
+    }
+    return result;
+  }
+
+  // Create a dense copy of this grid.
+  grid to_grid() const {
+    grid result(rows_, columns_);
+    for (coordinate r = 0; r < rows_; ++r) {
+      coordinate c = 0;
+      for (auto& run : runs_[r]) {
+        for (coordinate end = c + run.length; c < end; ++c) {
+          if (run.kind != CELL_SOIL) {
+            result.set(r, c, run.kind);
+          }
+        }
+      }
+    }
+    return result;
+  }
+
+  // Accessors.
+  coordinate rows() const { return rows_; }
+  coordinate columns() const { return columns_; }
+  const std::vector<cell_run>& row_runs(coordinate row) const {
+    assert(row < rows_);
+    return runs_[row];
+  }
+
+  // Return the total number of runs in all rows.
+  size_t run_count() const {
+    size_t total = 0;
+    for (auto& runs : runs_) {
+      total += runs.size();
+    }
+    return total;
+  }
+
+  // Replace the contents of one row. The run lengths must be positive and
+  // add up to columns(), and (0, 0) may only be CELL_SOIL. Adjacent runs of
+  // the same kind are merged.
+  void set_row(coordinate row, const std::vector<cell_run>& runs) {
+    assert(row < rows_);
+
+    std::vector<cell_run> merged;
+    coordinate total = 0;
+    for (auto& run : runs) {
+      assert(run.length > 0);
+      total += run.length;
+      if (!merged.empty() && (merged.back().kind == run.kind)) {
+        merged.back().length += run.length;
+      } else {
+        merged.push_back(run);
+      }
+    }
+    assert(total == columns_);
+    if (row == 0) {
+      assert(merged.front().kind == CELL_SOIL);
+    }
+    runs_[row] = std::move(merged);
+  }
+};
+
+namespace rle_detail {
+
+// Score of a cell that no path reaches. Far enough from the int64_t limits
+// that adding a row's worth of columns to it cannot overflow.
+const int64_t UNREACHABLE = std::numeric_limits<int64_t>::min() / 4;
+
+// One piece of a row's scores, covering columns from start up to the next
+// piece's start. The score at column x is value + slope * (x - start), or
+// UNREACHABLE everywhere when value is UNREACHABLE.
+struct score_piece {
+  coordinate start;
+  int64_t value;
+  int64_t slope;
+
+  int64_t at(coordinate x) const {
+    if (value == UNREACHABLE) {
+      return UNREACHABLE;
+    }
+    return value + slope * int64_t(x - start);
+  }
+};
+
+using score_row = std::vector<score_piece>;
+
+// Append a piece, merging it into the last one if it continues the same
+// line.
+void append(score_row& row, const score_piece& piece) {
+  if (!row.empty() &&
+      (row.back().slope == piece.slope) &&
+      (row.back().at(piece.start) == piece.value)) {
+    return;
+  }
+  row.push_back(piece);
+}
+
+// Return the score at column x.
+int64_t score_at(const score_row& row, coordinate x) {
+  auto it = std::upper_bound(row.begin(), row.end(), x,
+                             [](coordinate x, const score_piece& p) {
+                               return x < p.start;
+                             });
+  assert(it != row.begin());
+  return std::prev(it)->at(x);
+}
+
+// Compute one row of scores from the row above and this row's runs. Each
+// cell's score is the better of the scores above and to the left, plus one
+// if the cell is open, or UNREACHABLE for rocks and cells neither neighbour
+// reaches.
+score_row next_row(const score_row& above,
+                   const std::vector<cell_run>& runs,
+                   coordinate columns) {
+
+  score_row out;
+  int64_t carry = UNREACHABLE;  // score of the cell to the left
+  size_t piece = 0;
+  coordinate s = 0;
+
+  for (auto& run : runs) {
+    const coordinate e = s + run.length;
+
+    if (run.kind == CELL_ROCK) {
+      append(out, score_piece{s, UNREACHABLE, 0});
+      carry = UNREACHABLE;
+      s = e;
+      continue;
+    }
+
+    // Split the run where the pieces above begin, so that the score above
+    // is one line on each part [a, b).
+    for (coordinate a = s; a < e; ) {
+      while ((piece + 1 < above.size()) && (above[piece + 1].start <= a)) {
+        ++piece;
+      }
+      const coordinate b =
+        std::min(e, (piece + 1 < above.size()) ? above[piece + 1].start
+                                               : columns);
+      const int64_t v = above[piece].at(a);
+      const int64_t slope = above[piece].slope;
+
+      if (run.kind == CELL_OPEN) {
+        // Each cell beats the one above it by taking the running maximum
+        // and adding one, so the scores rise by one per column from the
+        // first cell onwards.
+        int64_t first = std::max(v, carry);
+        if (first == UNREACHABLE) {
+          append(out, score_piece{a, UNREACHABLE, 0});
+        } else {
+          append(out, score_piece{a, first + 1, 1});
+          carry = first + 1 + int64_t(b - 1 - a);
+        }
+      } else if ((v == UNREACHABLE) || (slope == 0)) {
+        // A running maximum against a constant is constant.
+        carry = std::max(carry, v);
+        append(out, score_piece{a, carry, 0});
+      } else {
+        // A running maximum against a rising line stays at carry until the
+        // line passes it at column t, then follows the line.
+        coordinate t = (carry < v) ? a : a + coordinate(carry - v + 1);
+        if (t >= b) {
+          append(out, score_piece{a, carry, 0});
+        } else {
+          if (t > a) {
+            append(out, score_piece{a, carry, 0});
+          }
+          append(out, score_piece{t, v + int64_t(t - a), 1});
+          carry = v + int64_t(b - 1 - a);
+        }
+      }
+      a = b;
+    }
+    s = e;
+  }
+  assert(s == columns);
+  return out;
+}
+
+}
+
+// Solve the economical pipes problem on a run-length-encoded grid.
+//
+// The result is identical to econ_pipes_dyn_prog on the equivalent dense
+// grid, including how ties are broken. Time and memory are proportional to
+// the number of runs plus the number of score pieces, which stays close to
+// the number of runs on terrain made of long uniform stretches, plus the
+// rows+columns steps of the path itself.
+solution_steps econ_pipes_rle(const rle_grid& setting) {
+
+  using namespace rle_detail;
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+
+  trace_scope phase("rle: fill");
+
+  // The row above row 0 lets a path start at (0, 0) and nowhere else.
+  score_row origin{{0, 0, 0}};
+  if (columns > 1) {
+    origin.push_back(score_piece{1, UNREACHABLE, 0});
+  }
+
+  std::vector<score_row> scores;
+  scores.reserve(rows);
+
+  // Track the highest score, keeping the last one in row-major order.
+  int64_t best = UNREACHABLE;
+  coordinate best_row = 0, best_column = 0;
+
+  for (coordinate r = 0; r < rows; ++r) {
+    scores.push_back(next_row((r == 0) ? origin : scores.back(),
+                              setting.row_runs(r), columns));
+    const auto& row = scores.back();
+    for (size_t i = 0; i < row.size(); ++i) {
+      coordinate last = ((i + 1 < row.size()) ? row[i + 1].start : columns) - 1;
+      int64_t value = row[i].at(last);
+      if ((value != UNREACHABLE) && (value >= best)) {
+        best = value;
+        best_row = r;
+        best_column = last;
+      }
+    }
+  }
+  assert(best != UNREACHABLE);
+
+  phase.next("rle: reconstruct path");
+
+  // Walk back, arriving from the left only when that scores strictly
+  // better than arriving from above, as econ_pipes_dyn_prog does.
+  solution_steps result;
+  result.final_row = best_row;
+  result.final_column = best_column;
+  result.total_open = unsigned(best);
+  result.steps.reserve(best_row + best_column);
+
+  coordinate r = best_row, c = best_column;
+  while ((r > 0) || (c > 0)) {
+    int64_t above = (r > 0) ? score_at(scores[r - 1], c) : UNREACHABLE;
+    int64_t left = (c > 0) ? score_at(scores[r], c - 1) : UNREACHABLE;
+    if (left > above) {
+      result.steps.push_back(STEP_DIRECTION_RIGHT);
+      --c;
+    } else {
+      assert(above != UNREACHABLE);
+      result.steps.push_back(STEP_DIRECTION_DOWN);
+      --r;
+    }
+  }
+  std::reverse(result.steps.begin(), result.steps.end());
+  return result;
+}
+
+}
@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_shared_path.hpp
+//
+// An immutable path that shares its prefix with the path it was extended
+// from.
+//
+// A shared_path is a handle to the last link of a chain of steps, each link
+// pointing at the one before it. Copying a shared_path copies one pointer,
+// and adding a step allocates one link, so extending a path never copies
+// the steps already taken. This makes it a cheap cell type for tables of
+// partial paths, such as the one in econ_pipes_dyn_prog, where every cell
+// is its neighbour's path plus one step. Convert to a path with to_path()
+// once the steps are needed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+class shared_path {
+private:
+
+  // One step, and everything about the path that ends with it.
+  struct link {
+    mutable std::shared_ptr<const link> parent;
+    step_direction direction;
+    coordinate row, column;
+    unsigned total_open;
+    size_t length;
+  };
+
+  const grid* setting_;
+  std::shared_ptr<const link> last_;
+
+public:
+
+  // Create a path containing only a start at the given cell, which must not
+  // be CELL_ROCK. The start cell counts towards total_open() if it is
+  // CELL_OPEN.
+  shared_path(const grid& setting,
+              coordinate start_row = 0, coordinate start_column = 0)
+  : setting_(&setting) {
+    assert(setting.may_step(start_row, start_column));
+    last_ = std::make_shared<const link>(link{
+      nullptr, STEP_DIRECTION_START, start_row, start_column,
+      (setting.get(start_row, start_column) == CELL_OPEN) ? 1u : 0u, 1});
+  }
+
+  shared_path(const shared_path&) = default;
+  shared_path(shared_path&&) = default;
+
+  // Taking other by value lets its destructor release the old chain.
+  shared_path& operator=(shared_path other) {
+    setting_ = other.setting_;
+    std::swap(last_, other.last_);
+    return *this;
+  }
+
+  // Release links no other path shares one at a time, rather than through
+  // nested shared_ptr destructors, which could overflow the stack for a
+  // long path.
+  ~shared_path() {
+    auto node = std::move(last_);
+    while (node && (node.use_count() == 1)) {
+      auto parent = std::move(node->parent);
+      node = std::move(parent);
+    }
+  }
+
+  // Accessors.
+  const grid& setting() const { return *setting_; }
+  coordinate final_row() const { return last_->row; }
+  coordinate final_column() const { return last_->column; }
+  unsigned total_open() const { return last_->total_open; }
+
+  // Return the number of steps, counting the start, as path::steps().size()
+  // would.
+  size_t size() const { return last_->length; }
+
+  // Return true if adding the given step is valid, as path::is_step_valid.
+  bool is_step_valid(step_direction dir) const {
+    auto row = final_row() + step(dir).delta_row(),
+         column = final_column() + step(dir).delta_column();
+    return ((dir != STEP_DIRECTION_START) &&
+            setting_->is_row_column(row, column) &&
+            setting_->may_step(row, column));
+  }
+
+  // Add one step, which must be valid. Other paths that share this one's
+  // steps are unaffected.
+  void add_step(step_direction dir) {
+    assert(is_step_valid(dir));
+    auto row = final_row() + step(dir).delta_row(),
+         column = final_column() + step(dir).delta_column();
+    unsigned open = total_open() +
+                    ((setting_->get(row, column) == CELL_OPEN) ? 1 : 0);
+    last_ = std::make_shared<const link>(link{
+      last_, dir, row, column, open, last_->length + 1});
+  }
+
+  // Return a copy of this path with one more step, which must be valid.
+  shared_path with_step(step_direction dir) const {
+    shared_path result(*this);
+    result.add_step(dir);
+    return result;
+  }
+
+  // Build the equivalent path. Takes time proportional to size().
+  path to_path() const {
+    std::vector<step_direction> directions;
+    directions.reserve(size() - 1);
+    const link* first = last_.get();
+    for (; first->direction != STEP_DIRECTION_START;
+         first = first->parent.get()) {
+      directions.push_back(first->direction);
+    }
+    std::reverse(directions.begin(), directions.end());
+    return path(*setting_, first->row, first->column, directions);
+  }
+};
+
+}
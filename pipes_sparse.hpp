@@ -0,0 +1,535 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_sparse.hpp
+//
+// A solver for the economical pipes problem on sparse maps, where only a few
+// cells are open or rock and the rest is soil.
+//
+// The solver never looks at soil cells. It works from coordinate lists of the
+// open and rock cells, so its running time depends on the number of those
+// special cells instead of on rows*columns.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+// A grid stored as sorted lists of its open and rock cells; every other cell
+// is CELL_SOIL.
+//
+// Rocks are indexed both row-major and column-major, so that checking
+// whether a straight horizontal or vertical segment is free of rocks costs
+// one binary search.
+class sparse_grid {
+private:
+  coordinate rows_, columns_;
+  std::vector<grid_position> open_;
+  std::vector<grid_position> rocks_by_row_;
+  // Same rocks as rocks_by_row_, but with row and column swapped.
+  std::vector<grid_position> rocks_by_column_;
+
+  // Return true if sorted contains a position in line major with minor
+  // between first and last inclusive.
+  static bool any_between(const std::vector<grid_position>& sorted,
+                          coordinate major,
+                          coordinate first, coordinate last) {
+    if (first > last) {
+      return false;
+    }
+    auto it = std::lower_bound(sorted.begin(), sorted.end(),
+                               grid_position(major, first));
+    return ((it != sorted.end()) &&
+            (it->row == major) &&
+            (it->column <= last));
+  }
+
+public:
+
+  // Create a sparse grid with the given dimensions, open cells, and rock
+  // cells. The two lists may be in any order, but must not overlap, must not
+  // contain duplicates, and must not contain (0, 0).
+  sparse_grid(coordinate rows, coordinate columns,
+              std::vector<grid_position> open,
+              std::vector<grid_position> rocks)
+  : rows_(rows), columns_(columns),
+    open_(std::move(open)), rocks_by_row_(std::move(rocks)) {
+
+    assert(rows > 0);
+    assert(columns > 0);
+
+    std::sort(open_.begin(), open_.end());
+    std::sort(rocks_by_row_.begin(), rocks_by_row_.end());
+
+    rocks_by_column_.reserve(rocks_by_row_.size());
+    for (auto& p : rocks_by_row_) {
+      assert(is_row_column(p.row, p.column));
+      assert(!((p.row == 0) && (p.column == 0)));
+      rocks_by_column_.emplace_back(p.column, p.row);
+    }
+    std::sort(rocks_by_column_.begin(), rocks_by_column_.end());
+
+    for (auto& p : open_) {
+      assert(is_row_column(p.row, p.column));
+      assert(!((p.row == 0) && (p.column == 0)));
+      assert(!is_rock(p.row, p.column));
+    }
+  }
+
+  // Create a sparse grid holding the same cells as a dense grid.
+  static sparse_grid from_grid(const grid& setting) {
+    std::vector<grid_position> open, rocks;
+    for (coordinate r = 0; r < setting.rows(); ++r) {
+      for (coordinate c = 0; c < setting.columns(); ++c) {
+        auto cell = setting.get(r, c);
+        if (cell == CELL_OPEN) {
+          open.emplace_back(r, c);
+        } else if (cell == CELL_ROCK) {
+          rocks.emplace_back(r, c);
+        }
+      }
+    }
+    return sparse_grid(setting.rows(), setting.columns(),
+                       std::move(open), std::move(rocks));
+  }
+
+  // Accessors.
+  coordinate rows() const { return rows_; }
+  coordinate columns() const { return columns_; }
+  const std::vector<grid_position>& open_cells() const { return open_; }
+  const std::vector<grid_position>& rock_cells() const {
+    return rocks_by_row_;
+  }
+
+  // Test whether the given value is a valid row or column number.
+  bool is_row_column(coordinate row, coordinate column) const {
+    return (row < rows_) && (column < columns_);
+  }
+
+  // Return true if the given cell is CELL_ROCK.
+  bool is_rock(coordinate row, coordinate column) const {
+    return any_between(rocks_by_row_, row, column, column);
+  }
+
+  // Return true if no cell in the given row, between the two columns
+  // inclusive, is CELL_ROCK. An empty range is clear.
+  bool row_clear(coordinate row,
+                 coordinate first_column, coordinate last_column) const {
+    return !any_between(rocks_by_row_, row, first_column, last_column);
+  }
+
+  // Return true if no cell in the given column, between the two rows
+  // inclusive, is CELL_ROCK. An empty range is clear.
+  bool column_clear(coordinate column,
+                    coordinate first_row, coordinate last_row) const {
+    return !any_between(rocks_by_column_, column, first_row, last_row);
+  }
+
+  // Call f(position) for each rock inside the rectangle with the given
+  // top-left and bottom-right corners. Rows that hold rocks only outside the
+  // rectangle cost one binary search each.
+  template <typename Function>
+  void for_each_rock_in(const grid_position& top_left,
+                        const grid_position& bottom_right,
+                        Function&& f) const {
+    auto it = std::lower_bound(rocks_by_row_.begin(), rocks_by_row_.end(),
+                               top_left);
+    while ((it != rocks_by_row_.end()) && (it->row <= bottom_right.row)) {
+      if (it->column < top_left.column) {
+        it = std::lower_bound(it, rocks_by_row_.end(),
+                              grid_position(it->row, top_left.column));
+      } else if (it->column > bottom_right.column) {
+        it = std::lower_bound(it, rocks_by_row_.end(),
+                              grid_position(it->row + 1, top_left.column));
+      } else {
+        f(*it);
+        ++it;
+      }
+    }
+  }
+};
+
+namespace sparse_detail {
+
+// An inclusive range of columns.
+using column_span = std::pair<coordinate, coordinate>;
+
+// The cells of one row that a route's start can reach, as sorted, disjoint
+// spans.
+struct reach_row {
+  coordinate row;
+  std::vector<column_span> spans;
+};
+
+// Return the reachable spans of a row, given those of the row above and the
+// columns of this row's rocks, in order, between first_column and
+// last_column. In every rock-free segment of the row, the reachable cells
+// run from the first one reachable from above to the end of the segment.
+std::vector<column_span> reach_below(const std::vector<column_span>& above,
+                                     const std::vector<coordinate>& rocks,
+                                     coordinate first_column,
+                                     coordinate last_column) {
+  std::vector<column_span> result;
+  size_t a = 0;
+  coordinate segment = first_column;
+  for (size_t i = 0; i <= rocks.size(); ++i) {
+    coordinate end = (i < rocks.size()) ? rocks[i] : last_column + 1;
+    if (segment < end) {
+      while ((a < above.size()) && (above[a].second < segment)) {
+        ++a;
+      }
+      if ((a < above.size()) && (above[a].first < end)) {
+        result.emplace_back(std::max(segment, above[a].first), end - 1);
+      }
+    }
+    segment = end + 1;
+  }
+  return result;
+}
+
+// The span of spans holding column, which must be at or right of the first
+// span's start; or, if column falls between spans, the one before it.
+std::vector<column_span>::const_iterator
+span_at(const std::vector<column_span>& spans, coordinate column) {
+  auto it = std::upper_bound(spans.begin(), spans.end(), column,
+                             [](coordinate c, const column_span& s) {
+                               return c < s.first;
+                             });
+  assert(it != spans.begin());
+  return --it;
+}
+
+// Find a path from one cell to another that only moves right and down, and
+// does not step on a rock. from must dominate to, i.e. be above and to the
+// left of it, and must not be a rock itself.
+//
+// If route is not null and a path exists, its steps are appended to route.
+// Returns whether a path exists.
+//
+// The two L-shaped paths are tried first, which settles the common case with
+// a few binary searches. Otherwise the rows of the rectangle between the two
+// cells that hold rocks are swept in order, carrying the spans of each row
+// that from can reach; rock-free rows in between just extend the reachable
+// cells to the right edge. This takes time linear in the number of rocks in
+// the rectangle, and the stored spans are enough to walk a route back.
+bool find_route(const sparse_grid& setting,
+                const grid_position& from, const grid_position& to,
+                std::vector<step_direction>* route) {
+
+  assert(from.row <= to.row);
+  assert(from.column <= to.column);
+
+  auto emit = [&](step_direction dir, coordinate count) {
+    if (route) {
+      route->insert(route->end(), count, dir);
+    }
+  };
+
+  coordinate down = to.row - from.row,
+             right = to.column - from.column;
+
+  // Right, then down.
+  if (setting.row_clear(from.row, from.column + 1, to.column) &&
+      setting.column_clear(to.column, from.row + 1, to.row)) {
+    emit(STEP_DIRECTION_RIGHT, right);
+    emit(STEP_DIRECTION_DOWN, down);
+    return true;
+  }
+
+  // Down, then right.
+  if (setting.column_clear(from.column, from.row + 1, to.row) &&
+      setting.row_clear(to.row, from.column + 1, to.column)) {
+    emit(STEP_DIRECTION_DOWN, down);
+    emit(STEP_DIRECTION_RIGHT, right);
+    return true;
+  }
+
+  std::vector<grid_position> rocks;
+  setting.for_each_rock_in(from, to, [&](const grid_position& p) {
+    rocks.push_back(p);
+  });
+
+  std::vector<reach_row> swept;
+  std::vector<coordinate> row_rocks;
+  std::vector<column_span> above{{from.column, from.column}};
+  size_t next = 0;
+  for (coordinate r = from.row; ; ) {
+    row_rocks.clear();
+    while ((next < rocks.size()) && (rocks[next].row == r)) {
+      row_rocks.push_back(rocks[next++].column);
+    }
+    swept.push_back({r, reach_below(above, row_rocks,
+                                    from.column, to.column)});
+    const auto& spans = swept.back().spans;
+    if (spans.empty()) {
+      return false;
+    }
+    if (r == to.row) {
+      break;
+    }
+    coordinate following = (next < rocks.size()) ? rocks[next].row
+                                                  : to.row;
+    if (following == r + 1) {
+      above = spans;
+    } else {
+      above.assign(1, column_span(spans.front().first, to.column));
+    }
+    r = following;
+  }
+
+  if (swept.back().spans.back().second != to.column) {
+    return false;
+  }
+
+  if (route) {
+    // Walk back from to. Within a row, the span holding the current cell
+    // starts at a cell entered from above; across rock-free rows, go
+    // straight up, then left along the lowest of them to the nearest cell
+    // reachable in the swept row above.
+    std::vector<std::pair<step_direction, coordinate>> reversed;
+    coordinate c = to.column;
+    for (size_t i = swept.size(); i-- > 0; ) {
+      coordinate entry = span_at(swept[i].spans, c)->first;
+      reversed.emplace_back(STEP_DIRECTION_RIGHT, c - entry);
+      if (i == 0) {
+        assert(entry == from.column);
+        break;
+      }
+      coordinate gap = swept[i].row - swept[i - 1].row - 1;
+      if (gap == 0) {
+        c = entry;
+      } else {
+        c = std::min(entry, span_at(swept[i - 1].spans, entry)->second);
+        reversed.emplace_back(STEP_DIRECTION_DOWN, gap);
+        reversed.emplace_back(STEP_DIRECTION_RIGHT, entry - c);
+      }
+      reversed.emplace_back(STEP_DIRECTION_DOWN, 1);
+    }
+    for (auto it = reversed.rbegin(); it != reversed.rend(); ++it) {
+      emit(it->first, it->second);
+    }
+  }
+
+  return true;
+}
+
+// The best score of any path ending in each column of the row last swept,
+// kept as a step function: the entry at column c covers columns c up to the
+// next entry.
+struct score_piece {
+  // Open cells on the path, plus one; 0 when no path reaches the column.
+  unsigned score;
+
+  // The last open cell on such a path, or the number of open cells when the
+  // path has none.
+  size_t source;
+};
+
+using score_row = std::map<coordinate, score_piece>;
+
+// Make an entry start at column, splitting the one covering it, and return
+// it.
+score_row::iterator split_at(score_row& scores, coordinate column) {
+  auto it = scores.lower_bound(column);
+  if ((it != scores.end()) && (it->first == column)) {
+    return it;
+  }
+  return scores.emplace_hint(it, column, std::prev(it)->second);
+}
+
+// Raise every score in columns [first, last] to at least carry's, and
+// return the score at last afterwards. Scores must not decrease from left
+// to right within the range, so only the entries that are overwritten, and
+// the one after them, are visited.
+score_piece raise_run(score_row& scores, coordinate first, coordinate last,
+                      coordinate columns, const score_piece& carry) {
+  auto begin = split_at(scores, first),
+       end = (last + 1 < columns) ? split_at(scores, last + 1) : scores.end();
+  auto it = begin;
+  while ((it != end) && (it->second.score < carry.score)) {
+    ++it;
+  }
+  if (it != begin) {
+    scores.erase(begin, it);
+    scores.emplace_hint(it, first, carry);
+  }
+  return std::prev(end)->second;
+}
+
+}
+
+// Solve the economical pipes problem on a sparse grid.
+//
+// The rows holding open cells or rocks are swept in order, carrying the best
+// score of any path ending in each column of the row as a step function.
+// Within a row, a cell's score is the better of the one above it and the
+// one to its left, plus one if it is open, and nothing past a rock. So
+// after a row is swept, its scores only decrease at its rocks, and each run
+// between those is updated by overwriting the entries the score carried
+// from the left beats, after which the rest of the run stays as it was. A
+// rock-free row in between is the same sweep with no cells. Every entry is
+// created by a cell or rock and overwritten at most once, so the sweep takes
+// O(k log k) time for k open cells and rocks, however the rocks are placed.
+//
+// Each open cell remembers the previous open cell on its best path. The
+// path is rebuilt by routing between consecutive open cells of that chain;
+// the rectangles between them do not overlap, so routing costs little more
+// than the sweep.
+solution_steps econ_pipes_sparse(const sparse_grid& setting) {
+
+  using namespace sparse_detail;
+
+  const auto& open = setting.open_cells();
+  const auto& rocks = setting.rock_cells();
+  const size_t k = open.size();
+  const coordinate columns = setting.columns();
+  const grid_position start(0, 0);
+
+  trace_scope phase("sparse: sweep");
+
+  // Open cells on the best path ending at each open cell (0 when (0, 0)
+  // cannot reach it), and the previous open cell on that path (k for none).
+  std::vector<unsigned> length(k, 0);
+  std::vector<size_t> previous(k, k);
+
+  // Above row 0, only column 0 is reached, and scores drop at column 1.
+  score_row scores;
+  scores.emplace(0, score_piece{1, k});
+  if (columns > 1) {
+    scores.emplace(1, score_piece{0, k});
+  }
+  std::vector<coordinate> drops{1}, row_rocks;
+
+  // The cells of one row in column order, each an open cell's index or k
+  // for a rock.
+  std::vector<std::pair<coordinate, size_t>> cells;
+
+  auto sweep = [&]() {
+    score_piece carry{0, k};
+    coordinate at = 0;
+    size_t d = 0;
+
+    // Sweep columns [at, to), which hold no cells, in runs split at drops.
+    auto advance = [&](coordinate to) {
+      while (at < to) {
+        while ((d < drops.size()) && (drops[d] <= at)) {
+          ++d;
+        }
+        coordinate stop = ((d < drops.size()) && (drops[d] < to)) ? drops[d]
+                                                                  : to;
+        carry = raise_run(scores, at, stop - 1, columns, carry);
+        at = stop;
+      }
+    };
+
+    for (auto& cell : cells) {
+      advance(cell.first);
+      auto here = split_at(scores, cell.first);
+      if (cell.first + 1 < columns) {
+        split_at(scores, cell.first + 1);
+      }
+      if (cell.second == k) {
+        here->second = score_piece{0, k};
+      } else {
+        score_piece best = (carry.score > here->second.score) ? carry
+                                                              : here->second;
+        if (best.score > 0) {
+          length[cell.second] = best.score;
+          previous[cell.second] = best.source;
+          here->second = score_piece{best.score + 1, cell.second};
+        }
+      }
+      carry = here->second;
+      at = cell.first + 1;
+    }
+    advance(columns);
+  };
+
+  coordinate next_row = 0;
+  for (size_t o = 0, x = 0; (o < k) || (x < rocks.size()); ) {
+    coordinate row = std::min((o < k) ? open[o].row : setting.rows(),
+                              (x < rocks.size()) ? rocks[x].row
+                                                 : setting.rows());
+    // The rows with no cells since the last sweep all sweep alike, and once
+    // is enough.
+    if (row > next_row) {
+      cells.clear();
+      sweep();
+      drops.clear();
+    }
+
+    cells.clear();
+    row_rocks.clear();
+    while ((o < k) && (open[o].row == row)) {
+      cells.emplace_back(open[o].column, o);
+      ++o;
+    }
+    const size_t open_in_row = cells.size();
+    while ((x < rocks.size()) && (rocks[x].row == row)) {
+      cells.emplace_back(rocks[x].column, k);
+      row_rocks.push_back(rocks[x].column);
+      ++x;
+    }
+    std::inplace_merge(cells.begin(), cells.begin() + open_in_row,
+                       cells.end());
+
+    sweep();
+
+    // From now on, scores only drop at this row's rocks.
+    std::swap(drops, row_rocks);
+    next_row = row + 1;
+  }
+
+  size_t best_end = k;
+  for (size_t j = 0; j < k; ++j) {
+    if ((length[j] > 0) &&
+        ((best_end == k) || (length[j] > length[best_end]))) {
+      best_end = j;
+    }
+  }
+
+  solution_steps result;
+  if (best_end == k) {
+    return result;
+  }
+
+  phase.next("sparse: reconstruct path");
+
+  // Follow the chain back to the start, then route through it forwards.
+  std::vector<size_t> chain;
+  for (size_t j = best_end; j != k; j = previous[j]) {
+    chain.push_back(j);
+  }
+  std::reverse(chain.begin(), chain.end());
+
+  result.steps.reserve(open[best_end].row + open[best_end].column);
+  grid_position here = start;
+  for (auto j : chain) {
+    bool found = find_route(setting, here, open[j], &result.steps);
+    assert(found);
+    (void)found;
+    here = open[j];
+  }
+  result.final_row = here.row;
+  result.final_column = here.column;
+  result.total_open = length[best_end];
+  return result;
+}
+
+// Solve the economical pipes problem for a dense grid with the sparse
+// solver. This is mostly useful for testing; building the sparse grid scans
+// every cell.
+path econ_pipes_sparse(const grid& setting) {
+  return econ_pipes_sparse(sparse_grid::from_grid(setting)).to_path(setting);
+}
+
+}
@@ -6,12 +6,34 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <random>
+#include <sstream>
+#include <thread>
 
 #include "rubrictest.hpp"
 
 #include "pipes_types.hpp"
 #include "pipes_algs.hpp"
+#include "pipes_async.hpp"
+#include "pipes_bands.hpp"
+#include "pipes_beam.hpp"
+#include "pipes_bitslice.hpp"
+#include "pipes_bulk.hpp"
+#include "pipes_cache.hpp"
+#include "pipes_dispatch.hpp"
+#include "pipes_endpoints.hpp"
+#include "pipes_lockstep.hpp"
+#include "pipes_narrow.hpp"
+#include "pipes_protocol.hpp"
+#include "pipes_rle.hpp"
+#include "pipes_shared_path.hpp"
+#include "pipes_trace.hpp"
+#include "pipes_workspace.hpp"
+#include "pipes_enumerate.hpp"
+#include "pipes_sparse.hpp"
 
 int main() {
 
@@ -133,5 +155,768 @@ int main() {
          }
 		   });
 
+  rubric.criterion("sparse solver", 2,
+		   [&]() {
+         TEST_EQUAL("empty4", empty4_solution, econ_pipes_sparse(empty4));
+         TEST_EQUAL("horizontal", horizontal_solution,
+		    econ_pipes_sparse(horizontal));
+         TEST_EQUAL("vertical", vertical_solution,
+		    econ_pipes_sparse(vertical));
+         TEST_EQUAL("maze", maze_solution, econ_pipes_sparse(maze));
+         TEST_EQUAL("large", econ_pipes_dyn_prog(large_random).total_open(),
+		    econ_pipes_sparse(large_random).total_open());
+
+         // Dense rocks force the reachability sweep.
+         std::mt19937 gen(20191201);
+         for (unsigned trial = 0; trial < 40; ++trial) {
+           pipes::coordinate rows = 1 + trial % 9,
+                             columns = 1 + (trial * 7) % 13;
+           auto area = rows * columns;
+           pipes::grid setting = pipes::grid::random(rows, columns, area / 4,
+						     area / 3, gen);
+           TEST_EQUAL("random grid " + std::to_string(trial),
+                      pipes::econ_pipes_dyn_prog(setting).total_open(),
+                      pipes::econ_pipes_sparse(setting).total_open());
+         }
+
+         // Far too large to store densely.
+         pipes::sparse_grid huge(100000, 100000,
+                                 {{5, 5}, {10, 10}, {5, 99999},
+                                  {99999, 10}, {99999, 99999}},
+                                 {{5, 6}, {6, 5}, {99998, 99999}});
+         auto solution = pipes::econ_pipes_sparse(huge);
+         TEST_EQUAL("huge total open", 3, solution.total_open);
+         TEST_EQUAL("huge path length", 99999 + 99999, solution.steps.size());
+
+         // Rock walls across most of a row or column, with rocks scattered
+         // on both sides.
+         for (unsigned trial = 0; trial < 4; ++trial) {
+           pipes::grid setting = pipes::grid::random(400, 400, 3000, 4000,
+                                                     gen);
+           for (pipes::coordinate i = 0; i < 360; ++i) {
+             if (trial % 2) {
+               setting.set(i, 200, pipes::CELL_ROCK);
+             } else {
+               setting.set(200, i, pipes::CELL_ROCK);
+             }
+           }
+           TEST_EQUAL("walled grid " + std::to_string(trial),
+                      pipes::econ_pipes_narrow(setting).total_open,
+                      pipes::econ_pipes_sparse(setting).total_open());
+         }
+
+         // A huge map split by a wall of 40000 rocks, with open cells on
+         // both sides. Open cells below the left of the wall cannot be
+         // reached. Rocks beside every open cell above the wall block both
+         // L-shaped routes from it to the next.
+         {
+           std::vector<pipes::grid_position> open, rocks;
+           for (pipes::coordinate c = 0; c < 40000; ++c) {
+             rocks.emplace_back(50000, c);
+           }
+           for (pipes::coordinate i = 1; i <= 1000; ++i) {
+             open.emplace_back(i * 10, i * 10);
+             rocks.emplace_back(i * 10 + 5, i * 10);
+             rocks.emplace_back(i * 10, i * 10 + 5);
+           }
+           for (pipes::coordinate i = 1; i <= 1500; ++i) {
+             open.emplace_back(50001 + i * 10, 20000 + i * 10);
+           }
+           for (pipes::coordinate i = 1; i <= 500; ++i) {
+             open.emplace_back(50001 + i * 10, 40000 + i * 10);
+           }
+           pipes::sparse_grid walled(100000, 100000, open, rocks);
+           auto solution = pipes::econ_pipes_sparse(walled);
+           TEST_EQUAL("walled total open", 1500, solution.total_open);
+
+           // Walk the route, checking it avoids rocks and counting the open
+           // cells it passes.
+           pipes::coordinate r = 0, c = 0;
+           unsigned passed = 0;
+           bool clear = true;
+           for (auto dir : solution.steps) {
+             if (dir == pipes::STEP_DIRECTION_RIGHT) {
+               ++c;
+             } else {
+               ++r;
+             }
+             clear = clear && !walled.is_rock(r, c);
+             passed += std::binary_search(walled.open_cells().begin(),
+                                          walled.open_cells().end(),
+                                          pipes::grid_position(r, c));
+           }
+           TEST_TRUE("walled route avoids rocks", clear);
+           TEST_EQUAL("walled route open cells", 1500, passed);
+           TEST_TRUE("walled route end",
+                     (r == solution.final_row) && (c == solution.final_column));
+         }
+		   });
+
+  rubric.criterion("lazy candidate enumeration", 1,
+		   [&]() {
+         unsigned count = 0;
+         for (auto& candidate : pipes::candidate_paths(empty2)) {
+           (void)candidate;
+           ++count;
+         }
+         TEST_EQUAL("empty2 candidates", 5, count);
+
+         pipes::candidate_options corner;
+         corner.fixed_endpoint = true;
+         corner.end_row = corner.end_column = 3;
+         count = 0;
+         for (auto& candidate : pipes::candidate_paths(empty4, corner)) {
+           TEST_EQUAL("corner length", 6, candidate.steps().size());
+           ++count;
+         }
+         TEST_EQUAL("empty4 corner candidates", 20, count);
+
+         pipes::candidate_paths maze_candidates(maze, corner);
+         TEST_TRUE("maze has a corner path", maze_candidates.next());
+         TEST_EQUAL("maze corner path", maze_solution,
+		    maze_candidates.to_path());
+         TEST_FALSE("maze has one corner path", maze_candidates.next());
+
+         pipes::candidate_options rich;
+         rich.min_open = 2;
+         count = 0;
+         for (auto& candidate : pipes::candidate_paths(small_random, rich)) {
+           ++count;
+           TEST_GE("min_open", candidate.total_open(), 2);
+           TEST_EQUAL("to_path", candidate.total_open(),
+		      candidate.to_path().total_open());
+         }
+         TEST_GT("min_open candidates", count, 0);
+
+         unsigned best = 0;
+         for (auto& candidate : pipes::candidate_paths(small_random)) {
+           best = std::max(best, candidate.total_open());
+         }
+         TEST_EQUAL("small best", econ_pipes_exhaustive(small_random).total_open(),
+		    best);
+		   });
+
+  rubric.criterion("asynchronous solve", 1,
+		   [&]() {
+         auto handle = pipes::solve_async(maze, pipes::econ_pipes_dyn_prog);
+         auto result = handle.get();
+         TEST_EQUAL("complete", pipes::SOLVE_COMPLETE, result.status);
+         TEST_EQUAL("maze", maze_solution, result.best);
+
+         // 2^30 bit patterns would take minutes.
+         pipes::grid big(16, 16);
+         unsigned reports = 0;
+         pipes::solve_options options;
+         options.progress_interval = std::chrono::seconds(0);
+         options.on_progress = [&](const pipes::solve_progress& progress) {
+           ++reports;
+         };
+         auto slow = pipes::solve_async(big, pipes::econ_pipes_exhaustive,
+                                        options);
+         slow.cancel();
+         TEST_TRUE("cancelled promptly", slow.wait_for(std::chrono::seconds(5)));
+         TEST_EQUAL("cancelled", pipes::SOLVE_CANCELLED, slow.get().status);
+
+         options.deadline = std::chrono::steady_clock::now() +
+                            std::chrono::milliseconds(20);
+         auto late = pipes::solve_async(big, pipes::econ_pipes_exhaustive,
+                                        options);
+         TEST_TRUE("deadline", late.wait_for(std::chrono::seconds(5)));
+         TEST_EQUAL("deadline expired", pipes::SOLVE_DEADLINE_EXPIRED,
+		    late.get().status);
+         TEST_GT("progress reports", reports, 0);
+		   });
+
+  rubric.criterion("solve cache", 1,
+		   [&]() {
+         pipes::solve_cache cache(1 << 20);
+         auto solver = [](const pipes::grid& g) {
+           return pipes::econ_pipes_dyn_prog(g);
+         };
+         TEST_FALSE("cold", cache.lookup("dyn_prog", maze).has_value());
+         cache.solve("dyn_prog", maze, solver);
+         pipes::grid maze_copy = maze;
+         auto cached = cache.lookup("dyn_prog", maze_copy);
+         TEST_TRUE("warm", cached.has_value());
+         TEST_EQUAL("cached maze", maze_solution, *cached);
+         TEST_TRUE("rebuilt on the copy", &cached->setting() == &maze_copy);
+         TEST_FALSE("different contents",
+                    cache.lookup("dyn_prog", horizontal).has_value());
+
+         // A solver under another tag neither sees nor replaces the entry.
+         TEST_FALSE("other tag", cache.lookup("beam:1", maze).has_value());
+         pipes::path partial(maze);
+         TEST_EQUAL("other tag solves",
+                    partial,
+                    cache.solve("beam:1", maze,
+                                [&](const pipes::grid&) { return partial; }));
+         TEST_EQUAL("own tag kept", maze_solution,
+                    *cache.lookup("dyn_prog", maze));
+         TEST_EQUAL("other tag kept", partial, *cache.lookup("beam:1", maze));
+         auto stats = cache.stats();
+         TEST_EQUAL("hits", 3, stats.hits);
+         TEST_EQUAL("misses", 5, stats.misses);
+
+         // Room for only a few entries.
+         pipes::solve_cache small(1000);
+         std::mt19937 gen(3);
+         std::vector<pipes::grid> tiles;
+         for (unsigned i = 0; i < 8; ++i) {
+           tiles.push_back(pipes::grid::random(6, 6, 8, 4, gen));
+         }
+         for (auto& tile : tiles) {
+           small.solve("dyn_prog", tile, solver);
+         }
+         stats = small.stats();
+         TEST_GT("evictions", stats.evictions, 0);
+         TEST_LE("memory cap", stats.bytes, 1000);
+         TEST_TRUE("most recent kept",
+                   small.lookup("dyn_prog", tiles.back()).has_value());
+         TEST_FALSE("oldest evicted",
+                    small.lookup("dyn_prog", tiles.front()).has_value());
+
+         std::vector<std::thread> threads;
+         for (unsigned t = 0; t < 4; ++t) {
+           threads.emplace_back([&]() {
+             for (unsigned i = 0; i < 50; ++i) {
+               auto& tile = tiles[i % tiles.size()];
+               auto expected = pipes::econ_pipes_dyn_prog(tile).total_open();
+               auto found = small.solve("dyn_prog", tile, solver).total_open();
+               if (found != expected) {
+                 std::abort();
+               }
+             }
+           });
+         }
+         for (auto& thread : threads) {
+           thread.join();
+         }
+         stats = small.stats();
+         TEST_EQUAL("lookups", 8 + 2 + 200, stats.hits + stats.misses);
+		   });
+
+  rubric.criterion("multiple sources and sinks", 1,
+		   [&]() {
+         pipes::grid inlets(4, 4);
+         /*    ...S
+               .XX.
+               OOX.
+               ...O   */
+         inlets.set(1, 1, pipes::CELL_ROCK);
+         inlets.set(1, 2, pipes::CELL_ROCK);
+         inlets.set(2, 2, pipes::CELL_ROCK);
+         inlets.set(2, 0, pipes::CELL_OPEN);
+         inlets.set(2, 1, pipes::CELL_OPEN);
+         inlets.set(3, 3, pipes::CELL_OPEN);
+         auto solution = pipes::econ_pipes_endpoints(inlets,
+                                                     {{0, 3}, {2, 0}},
+                                                     {{0, 0}, {3, 3}, {3, 1}});
+         TEST_TRUE("reachable", solution.has_value());
+         TEST_EQUAL("source", 1, solution->source);
+         TEST_EQUAL("sink", 1, solution->sink);
+         TEST_EQUAL("total open", 3, solution->best.total_open());
+         TEST_EQUAL("path", pipes::path(inlets, 2, 0, {R, D, R, R}),
+		    solution->best);
+         TEST_FALSE("unreachable", pipes::econ_pipes_endpoints(
+                      inlets, {{3, 3}}, {{0, 0}}).has_value());
+
+         // From (0, 0) to anywhere is the ordinary problem.
+         std::mt19937 gen(42);
+         for (unsigned trial = 0; trial < 20; ++trial) {
+           auto setting = pipes::grid::random(8, 11, 20, 15, gen);
+           std::vector<pipes::grid_position> anywhere;
+           for (pipes::coordinate r = 8; r-- > 0; ) {
+             for (pipes::coordinate c = 11; c-- > 0; ) {
+               anywhere.emplace_back(r, c);
+             }
+           }
+           auto ordinary = pipes::econ_pipes_endpoints(setting, {{0, 0}},
+                                                       anywhere);
+           TEST_TRUE("origin reachable", ordinary.has_value());
+           auto expected = pipes::econ_pipes_dyn_prog(setting);
+           TEST_EQUAL("same steps", expected.steps(), ordinary->best.steps());
+         }
+		   });
+
+  rubric.criterion("run-length-encoded grid", 2,
+		   [&]() {
+         auto encoded = pipes::rle_grid::from_grid(maze);
+         TEST_EQUAL("maze runs", 9, encoded.run_count());
+         TEST_EQUAL("round trip", maze.printable(),
+		    encoded.to_grid().printable());
+         TEST_EQUAL("maze", maze_solution,
+		    pipes::econ_pipes_rle(encoded).to_path(maze));
+
+         std::mt19937 gen(31);
+         for (unsigned trial = 0; trial < 60; ++trial) {
+           pipes::coordinate rows = 1 + trial % 7,
+                             columns = 2 + (trial * 5) % 17;
+           auto area = rows * columns;
+           auto setting = pipes::grid::random(rows, columns, area / 4,
+                                              (trial % 3) * area / 8, gen);
+           auto expected = pipes::econ_pipes_dyn_prog(setting);
+           auto solution = pipes::econ_pipes_rle(
+                             pipes::rle_grid::from_grid(setting));
+           TEST_EQUAL("identical steps " + std::to_string(trial),
+                      expected.steps(), solution.to_path(setting).steps());
+           TEST_EQUAL("total open", expected.total_open(), solution.total_open);
+         }
+
+         // Long soil stretches with a few features.
+         pipes::rle_grid terrain(3000, 1000000);
+         terrain.set_row(5, {{pipes::CELL_SOIL, 400000},
+                             {pipes::CELL_OPEN, 10},
+                             {pipes::CELL_SOIL, 599990}});
+         terrain.set_row(9, {{pipes::CELL_ROCK, 500000},
+                             {pipes::CELL_SOIL, 500000}});
+         terrain.set_row(2999, {{pipes::CELL_SOIL, 999999},
+                                {pipes::CELL_OPEN, 1}});
+         auto solution = pipes::econ_pipes_rle(terrain);
+         TEST_EQUAL("terrain total open", 11, solution.total_open);
+         TEST_EQUAL("terrain path length", 2999 + 999999,
+		    solution.steps.size());
+		   });
+
+  rubric.criterion("band decomposition", 1,
+		   [&]() {
+         pipes::band_options serial;
+         serial.use_processes = false;
+         TEST_EQUAL("maze", maze_solution, pipes::econ_pipes_bands(maze));
+         TEST_EQUAL("maze in process", maze_solution,
+		    pipes::econ_pipes_bands(maze, serial));
+
+         std::mt19937 gen(32);
+         for (unsigned trial = 0; trial < 12; ++trial) {
+           pipes::band_options options;
+           options.bands = 1 + trial % 5;
+           options.block_columns = trial % 3;
+           options.use_processes = (trial % 2 == 0);
+           pipes::coordinate rows = 1 + trial * 2, columns = 3 + trial;
+           auto area = rows * columns;
+           auto setting = pipes::grid::random(rows, columns, area / 4,
+                                              area / 8, gen);
+           TEST_EQUAL("identical steps " + std::to_string(trial),
+                      pipes::econ_pipes_dyn_prog(setting).steps(),
+                      pipes::econ_pipes_bands(setting, options).steps());
+         }
+
+         auto large = pipes::grid::random(600, 600, 72000, 36000, gen);
+         TEST_EQUAL("large identical steps",
+		    pipes::econ_pipes_dyn_prog(large).steps(),
+		    pipes::econ_pipes_bands(large).steps());
+		   });
+
+  rubric.criterion("phase tracing", 1,
+		   [&]() {
+         pipes::trace_clear();
+         pipes::econ_pipes_dyn_prog(maze);
+         std::ostringstream disabled;
+         pipes::trace_write_chrome_json(disabled);
+         TEST_EQUAL("nothing recorded while disabled", std::string::npos,
+		    disabled.str().find("\"ph\":\"X\""));
+
+         pipes::trace_enable(true);
+         std::thread other([&]() { pipes::econ_pipes_dyn_prog(maze); });
+         other.join();
+         pipes::econ_pipes_dyn_prog(maze);
+         pipes::trace_enable(false);
+
+         std::ostringstream out;
+         pipes::trace_write_chrome_json(out);
+         auto json = out.str();
+         TEST_EQUAL("document start", 0, json.find("{\"displayTimeUnit\""));
+         for (auto phase : {"dyn_prog: allocate", "dyn_prog: fill",
+                            "dyn_prog: post-process",
+                            "dyn_prog: reconstruct path"}) {
+           TEST_NOT_EQUAL(phase, std::string::npos,
+			  json.find(std::string("\"") + phase + "\""));
+         }
+         size_t fills = 0;
+         for (size_t at = json.find("dyn_prog: fill"); at != std::string::npos;
+              at = json.find("dyn_prog: fill", at + 1)) {
+           ++fills;
+         }
+         TEST_EQUAL("one fill per thread", 2, fills);
+
+         // Threads that come and go take over the rings of threads that
+         // have exited, which keep their older events, so running one at a
+         // time they need at most one more ring.
+         auto count_of = [](const std::string& text, const std::string& s) {
+           size_t n = 0;
+           for (size_t at = text.find(s); at != std::string::npos;
+                at = text.find(s, at + 1)) {
+             ++n;
+           }
+           return n;
+         };
+         pipes::trace_enable(true);
+         for (int i = 0; i < 8; ++i) {
+           std::thread([&]() { pipes::econ_pipes_dyn_prog(maze); }).join();
+         }
+         pipes::trace_enable(false);
+         std::ostringstream reused;
+         pipes::trace_write_chrome_json(reused);
+         TEST_LE("rings reused", count_of(reused.str(), "thread_name"),
+		 count_of(json, "thread_name") + 1);
+         TEST_EQUAL("events kept", 10,
+		    count_of(reused.str(), "dyn_prog: fill"));
+         pipes::trace_clear();
+		   });
+
+  rubric.criterion("daemon protocol and workspace", 1,
+		   [&]() {
+         auto request = pipes::solve_request::from_grid(42, maze);
+         pipes::solve_request decoded_request;
+         TEST_TRUE("decode request",
+		   pipes::decode(pipes::encode(request), decoded_request));
+         TEST_EQUAL("request id", 42, decoded_request.id);
+         TEST_TRUE("request valid", decoded_request.valid());
+         bool same_cells = true;
+         for (pipes::coordinate r = 0; r < maze.rows(); ++r) {
+           for (pipes::coordinate c = 0; c < maze.columns(); ++c) {
+             same_cells &= (decoded_request.get(r, c) == maze.get(r, c));
+           }
+         }
+         TEST_TRUE("request cells", same_cells);
+         auto truncated = pipes::encode(request);
+         truncated.pop_back();
+         TEST_FALSE("truncated request",
+		    pipes::decode(truncated, decoded_request));
+
+         pipes::dyn_prog_workspace workspace;
+         pipes::solve_response response;
+         response.id = 42;
+         response.total_open = workspace.solve(maze).total_open;
+         response.set_steps(workspace.solve(maze).steps);
+         pipes::solve_response decoded_response;
+         TEST_TRUE("decode response",
+		   pipes::decode(pipes::encode(response), decoded_response));
+         TEST_EQUAL("response path", maze_solution,
+		    pipes::path(maze, 0, 0, decoded_response.directions()));
+
+         std::mt19937 gen(34);
+         for (unsigned trial = 0; trial < 20; ++trial) {
+           pipes::coordinate rows = 1 + trial % 7, columns = 1 + trial;
+           auto area = rows * columns;
+           auto setting = pipes::grid::random(rows, columns, area / 4,
+                                              area / 8, gen);
+           TEST_EQUAL("identical steps " + std::to_string(trial),
+                      pipes::econ_pipes_dyn_prog(setting).steps(),
+                      workspace.solve(setting).to_path(setting).steps());
+         }
+		   });
+
+  rubric.criterion("narrow score tables", 1,
+		   [&]() {
+         TEST_TRUE("uint8_t fits 128+127",
+		   pipes::score_type_fits<uint8_t>(128, 127));
+         TEST_FALSE("uint8_t does not fit 128+128",
+		    pipes::score_type_fits<uint8_t>(128, 128));
+         TEST_EQUAL("maze", maze_solution,
+		    pipes::econ_pipes_narrow(maze).to_path(maze));
+
+         std::mt19937 gen(35);
+         for (unsigned trial = 0; trial < 15; ++trial) {
+           pipes::coordinate rows = 1 + trial % 6, columns = 2 + trial;
+           auto area = rows * columns;
+           auto setting = pipes::grid::random(rows, columns, area / 4,
+                                              area / 8, gen);
+           auto expected = pipes::econ_pipes_dyn_prog(setting).steps();
+           auto name = std::to_string(trial);
+           TEST_EQUAL("uint8_t " + name, expected,
+		      pipes::econ_pipes_narrow_as<uint8_t>(setting)
+		        .to_path(setting).steps());
+           TEST_EQUAL("uint16_t " + name, expected,
+		      pipes::econ_pipes_narrow_as<uint16_t>(setting)
+		        .to_path(setting).steps());
+           TEST_EQUAL("uint32_t " + name, expected,
+		      pipes::econ_pipes_narrow_as<uint32_t>(setting)
+		        .to_path(setting).steps());
+         }
+
+         // Every cell but the start is open, so the best score is as large
+         // as the width allows.
+         for (pipes::coordinate columns : {127, 300}) {
+           pipes::grid open(128, columns);
+           for (pipes::coordinate r = 0; r < open.rows(); ++r) {
+             for (pipes::coordinate c = 0; c < columns; ++c) {
+               if ((r > 0) || (c > 0)) {
+                 open.set(r, c, pipes::CELL_OPEN);
+               }
+             }
+           }
+           TEST_EQUAL("all open " + std::to_string(columns),
+		      126 + columns, pipes::econ_pipes_narrow(open).total_open);
+         }
+		   });
+
+  rubric.criterion("beam search", 1,
+		   [&]() {
+         pipes::beam_options wide;
+         wide.width = 1000;
+         auto maze_beam = pipes::econ_pipes_beam(maze, wide);
+         TEST_TRUE("maze complete", maze_beam.complete);
+         TEST_EQUAL("maze", maze_solution, maze_beam.best.to_path(maze));
+         TEST_EQUAL("maze gap", 0,
+		    pipes::beam_gap(maze_beam, maze_solution).missing());
+
+         std::mt19937 gen(36);
+         for (unsigned trial = 0; trial < 15; ++trial) {
+           pipes::coordinate rows = 1 + trial % 6, columns = 2 + trial;
+           auto area = rows * columns;
+           auto setting = pipes::grid::random(rows, columns, area / 4,
+                                              area / 8, gen);
+           auto exact = pipes::econ_pipes_dyn_prog(setting);
+           auto name = std::to_string(trial);
+           TEST_EQUAL("unpruned " + name, exact.steps(),
+		      pipes::econ_pipes_beam(setting, wide).best
+		        .to_path(setting).steps());
+           pipes::beam_options narrow;
+           narrow.width = 2;
+           auto pruned = pipes::econ_pipes_beam(setting, narrow);
+           TEST_EQUAL("pruned total " + name, pruned.best.total_open,
+		      pruned.best.to_path(setting).total_open());
+           TEST_TRUE("pruned gap " + name,
+		     pipes::beam_gap(pruned, exact).ratio() <= 1.0);
+         }
+
+         auto no_rocks = pipes::grid::random(30, 30, 180, 0, gen);
+         pipes::beam_options budget;
+         budget.max_nodes = 10;
+         auto stopped = pipes::econ_pipes_beam(no_rocks, budget);
+         TEST_FALSE("node budget", stopped.complete);
+         TEST_EQUAL("node budget path", stopped.best.total_open,
+		    stopped.best.to_path(no_rocks).total_open());
+
+         pipes::solve_control control;
+         control.cancel();
+         auto cancelled = pipes::econ_pipes_beam(no_rocks,
+						 pipes::beam_options(),
+						 &control);
+         TEST_FALSE("cancelled", cancelled.complete);
+         TEST_EQUAL("cancelled status", pipes::SOLVE_CANCELLED,
+		    control.status());
+		   });
+
+  rubric.criterion("bit-sliced exhaustive search", 1,
+		   [&]() {
+         TEST_EQUAL("maze", maze_solution.total_open(),
+		    pipes::econ_pipes_bitsliced(maze).total_open());
+         TEST_EQUAL("one cell", 0,
+		    pipes::econ_pipes_bitsliced(pipes::grid(1, 1)).total_open());
+
+         std::mt19937 gen(37);
+         for (pipes::coordinate rows = 1; rows <= 5; ++rows) {
+           for (pipes::coordinate columns = 1; columns <= 12; ++columns) {
+             auto area = rows * columns;
+             auto setting = pipes::grid::random(rows, columns, area / 4,
+                                                area / 8, gen);
+             auto found = pipes::econ_pipes_bitsliced(setting);
+             auto name = std::to_string(rows) + "x" + std::to_string(columns);
+             TEST_EQUAL("same optimum " + name,
+			pipes::econ_pipes_exhaustive(setting).total_open(),
+			found.total_open());
+             TEST_EQUAL("matches dyn_prog " + name,
+			pipes::econ_pipes_dyn_prog(setting).total_open(),
+			found.total_open());
+           }
+         }
+		   });
+
+  rubric.criterion("shared paths", 1,
+		   [&]() {
+         pipes::shared_path start(all_open);
+         auto right = start.with_step(R);
+         auto down = right.with_step(D), across = right.with_step(R);
+         TEST_EQUAL("start untouched", 1, start.size());
+         TEST_EQUAL("branch down", 3, down.size());
+         TEST_EQUAL("branch across", 2, across.final_column());
+         TEST_EQUAL("down path", pipes::path(all_open, {R, D}),
+		    down.to_path());
+         TEST_EQUAL("across path", pipes::path(all_open, {R, R}),
+		    across.to_path());
+         TEST_EQUAL("open count", 2, down.total_open());
+
+         pipes::shared_path copy = down;
+         copy.add_step(D);
+         TEST_EQUAL("copy extended", 4, copy.size());
+         TEST_EQUAL("original unchanged", 3, down.size());
+
+         // Destroying a long chain must not recurse once per link.
+         pipes::grid corridor(1, 200000);
+         pipes::shared_path longest(corridor);
+         for (pipes::coordinate c = 1; c < corridor.columns(); ++c) {
+           longest.add_step(R);
+         }
+         TEST_EQUAL("long path", corridor.columns(),
+		    longest.to_path().steps().size());
+		   });
+
+  rubric.criterion("bulk route scoring", 1,
+		   [&]() {
+         auto maze_route = pipes::pack_route({R, D, R, D, R, D});
+         auto maze_score =
+           pipes::bitplane_grid(maze).score(pipes::packed_route{
+             maze_route.data(), 6});
+         TEST_TRUE("maze valid", maze_score.valid);
+         TEST_EQUAL("maze open", 1, maze_score.total_open);
+         TEST_EQUAL("maze end", 3, maze_score.final_row);
+
+         // Random routes on a grid wider than one word, checked against a
+         // cell-by-cell walk.
+         std::mt19937 gen(39);
+         auto setting = pipes::grid::random(70, 150, 2000, 300, gen);
+         pipes::bitplane_grid planes(setting);
+         const size_t COUNT = 5000;
+         std::vector<std::vector<uint64_t>> words(COUNT);
+         std::vector<pipes::packed_route> routes(COUNT);
+         std::uniform_int_distribution<size_t> length(0, 218);
+         for (size_t k = 0; k < COUNT; ++k) {
+           // Mostly right or mostly down, to make long runs.
+           std::bernoulli_distribution right((k % 3) ? 0.9 : 0.3);
+           std::vector<pipes::step_direction> steps(length(gen));
+           for (auto& s : steps) {
+             s = right(gen) ? R : D;
+           }
+           words[k] = pipes::pack_route(steps);
+           routes[k] = pipes::packed_route{words[k].data(), steps.size()};
+         }
+         std::vector<pipes::route_score> scores(COUNT);
+         pipes::score_routes(planes, routes.data(), COUNT, scores.data(), 4);
+
+         size_t mismatches = 0, valid = 0;
+         for (size_t k = 0; k < COUNT; ++k) {
+           pipes::route_score expected{true, 0, 0, 0};
+           for (size_t i = 0; i < routes[k].length; ++i) {
+             auto r = expected.final_row, c = expected.final_column;
+             ((words[k][i / 64] >> (i % 64)) & 1) ? ++c : ++r;
+             if (!setting.is_row_column(r, c) || !setting.may_step(r, c)) {
+               expected.valid = false;
+               break;
+             }
+             expected.final_row = r;
+             expected.final_column = c;
+             expected.total_open += (setting.get(r, c) == pipes::CELL_OPEN);
+           }
+           valid += expected.valid;
+           mismatches += (expected.valid != scores[k].valid) ||
+                         (expected.final_row != scores[k].final_row) ||
+                         (expected.final_column != scores[k].final_column) ||
+                         (expected.total_open != scores[k].total_open);
+         }
+         TEST_EQUAL("matches walk", 0, mismatches);
+         TEST_TRUE("some valid", valid > 0);
+         TEST_TRUE("some invalid", valid < COUNT);
+		   });
+
+  rubric.criterion("automatic dispatch", 1,
+		   [&]() {
+         auto defaults = pipes::cost_model::defaults();
+         auto tiny = pipes::grid_features::of(small_random);
+         TEST_TRUE("exhaustive on tiny grid",
+		   defaults.applicable(pipes::SOLVER_EXHAUSTIVE, tiny, 1));
+         TEST_FALSE("no exhaustive on large grid",
+		    defaults.applicable(pipes::SOLVER_EXHAUSTIVE,
+					pipes::grid_features::of(large_random),
+					1));
+         TEST_FALSE("no bands on one core",
+		    defaults.applicable(pipes::SOLVER_BANDS, tiny, 1));
+
+         // Bands fork, so they are only chosen when asked for.
+         pipes::grid_features wide{1000, 1000, 200000, 100000, 500000};
+         pipes::dispatch_options forking;
+         forking.cores = 64;
+         TEST_NOT_EQUAL("no bands by default", pipes::SOLVER_BANDS,
+			defaults.choose(wide, forking));
+         forking.use_processes = true;
+         TEST_EQUAL("bands on request", pipes::SOLVER_BANDS,
+		    defaults.choose(wide, forking));
+
+         std::mt19937 gen(40);
+         for (unsigned trial = 0; trial < 12; ++trial) {
+           pipes::coordinate rows = 1 + trial * 7, columns = 2 + trial * 5;
+           auto area = rows * columns;
+           // Every third grid is nearly empty, so the sparse solver is
+           // in the running.
+           unsigned scale = (trial % 3 == 0) ? 100 : 1;
+           auto setting = pipes::grid::random(rows, columns,
+                                              area / 5 / scale,
+                                              area / 10 / scale, gen);
+           pipes::dispatch_options options;
+           options.cores = 1 + trial % 3;
+           TEST_EQUAL("same optimum " + std::to_string(trial),
+		      pipes::econ_pipes_dyn_prog(setting).total_open(),
+		      pipes::econ_pipes_solve(setting, options).total_open());
+         }
+
+         // A memory limit rules out the table-based solvers, and when
+         // nothing fits the smallest wins.
+         auto big = pipes::grid_features::of(
+           pipes::grid::random(200, 200, 60, 30, gen));
+         pipes::dispatch_options limited;
+         limited.cores = 1;
+         limited.memory_limit = 30000;
+         auto chosen = defaults.choose(big, limited);
+         TEST_NOT_EQUAL("limited", pipes::SOLVER_DYN_PROG, chosen);
+         TEST_TRUE("limited fits",
+		   defaults.memory_bytes(chosen, big, 1) <= 30000);
+         limited.memory_limit = 1;
+         chosen = defaults.choose(big, limited);
+         for (int k = 0; k < pipes::SOLVER_KIND_COUNT; ++k) {
+           auto kind = pipes::solver_kind(k);
+           if (defaults.applicable(kind, big, 1)) {
+             TEST_TRUE(std::string("smallest beats ") +
+		       pipes::solver_name(kind),
+		       defaults.memory_bytes(chosen, big, 1) <=
+		       defaults.memory_bytes(kind, big, 1));
+           }
+         }
+
+         const std::string filename = "pipes_test_cost_model.txt";
+         std::remove(filename.c_str());
+         TEST_FALSE("missing model", pipes::cost_model::load(filename));
+         auto calibrated = pipes::cost_model::load_or_calibrate(filename);
+         auto loaded = pipes::cost_model::load(filename);
+         TEST_TRUE("model saved", loaded.has_value());
+         TEST_EQUAL("model round trip",
+		    calibrated.predict_ns(pipes::SOLVER_DYN_PROG, big, 1),
+		    loaded->predict_ns(pipes::SOLVER_DYN_PROG, big, 1));
+         std::ofstream(filename) << "not a cost model" << std::endl;
+         TEST_FALSE("malformed model", pipes::cost_model::load(filename));
+         std::remove(filename.c_str());
+		   });
+
+  rubric.criterion("lockstep batches", 1,
+		   [&]() {
+         TEST_TRUE("no grids", pipes::econ_pipes_lockstep({}).empty());
+         auto maze_batch = pipes::econ_pipes_lockstep({maze, maze});
+         TEST_EQUAL("maze", maze_solution, maze_batch[1].to_path(maze));
+
+         std::mt19937 gen(41);
+         const std::vector<std::pair<pipes::coordinate, pipes::coordinate>>
+           shapes = {{1, 9}, {9, 1}, {6, 6}, {12, 31}, {20, 40}};
+         // One count per shape, covering a single grid, partial batches,
+         // and whole ones.
+         const std::vector<size_t> counts = {1, 31, 32, 33, 70};
+         assert(counts.size() == shapes.size());
+         for (size_t k = 0; k < shapes.size(); ++k) {
+           auto rows = shapes[k].first, columns = shapes[k].second;
+           auto area = rows * columns;
+           std::vector<pipes::grid> settings;
+           for (size_t n = 0; n < counts[k]; ++n) {
+             settings.push_back(pipes::grid::random(rows, columns, area / 4,
+                                                    area / 8, gen));
+           }
+           auto solutions = pipes::econ_pipes_lockstep(settings);
+           size_t mismatches = 0;
+           for (size_t n = 0; n < settings.size(); ++n) {
+             mismatches += !(pipes::econ_pipes_dyn_prog(settings[n]).steps() ==
+                             solutions[n].to_path(settings[n]).steps());
+           }
+           TEST_EQUAL("identical steps " + std::to_string(rows) + "x" +
+		      std::to_string(columns), 0, mismatches);
+         }
+		   });
+
   return rubric.run();
 }
@@ -5,21 +5,33 @@
 // elapsed times precisely. You should modify this program to gather
 // all of your experimental data.
 //
+// Pass a filename to also record a trace of the solver phases there, in
+// Chrome trace_event JSON format.
+//
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
+#include <fstream>
 #include <random>
 #include <iostream>
 
 #include "timer.hpp"
 
 #include "pipes_algs.hpp"
+#include "pipes_bands.hpp"
+#include "pipes_beam.hpp"
+#include "pipes_dispatch.hpp"
+#include "pipes_trace.hpp"
 
 void print_bar() {
   std::cout << std::string(79, '-') << std::endl;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+
+  if (argc > 1) {
+    pipes::trace_enable(true);
+  }
 
   const size_t EXHAUSTIVE_SEARCH_MAX_N = 30;
 
@@ -72,6 +84,59 @@ int main() {
 	    << std::endl;
 
   print_bar();
+  std::cout << "beam search" << std::endl;
+  for (size_t width : {1, 4, 16, 64}) {
+    pipes::beam_options options;
+    options.width = width;
+    timer.reset();
+    auto beam_output = pipes::econ_pipes_beam(input, options);
+    elapsed = timer.elapsed();
+    auto gap = pipes::beam_gap(beam_output, dyn_prog_output);
+    std::cout << "width=" << width
+              << ", open=" << gap.found << "/" << gap.optimal
+              << ", nodes=" << beam_output.nodes
+              << ", elapsed time=" << elapsed << " seconds" << std::endl;
+  }
+
+  print_bar();
+  std::cout << "band decomposition" << std::endl;
+  {
+    // Each band only does its share of the sequential DP's work, so even
+    // on one core the bands should be no slower than it.
+    auto large = pipes::grid::random(600, 600, 72000, 36000, gen);
+    timer.reset();
+    auto expected = econ_pipes_dyn_prog(large);
+    double dyn_prog_elapsed = timer.elapsed();
+    timer.reset();
+    auto banded = pipes::econ_pipes_bands(large);
+    elapsed = timer.elapsed();
+    std::cout << "600x600, dyn_prog=" << dyn_prog_elapsed
+              << " seconds, bands=" << elapsed << " seconds, "
+              << (banded.steps() == expected.steps() ? "identical"
+                                                     : "DIFFERENT")
+              << std::endl;
+  }
+
+  print_bar();
+  std::cout << "automatic dispatch" << std::endl;
+  auto model = pipes::cost_model::load_or_calibrate("pipes_cost_model.txt");
+  pipes::dispatch_options options;
+  options.model = &model;
+  auto kind = model.choose(pipes::grid_features::of(input), options);
+  timer.reset();
+  auto dispatch_output = pipes::econ_pipes_solve(input, options);
+  elapsed = timer.elapsed();
+  std::cout << "chose " << pipes::solver_name(kind)
+            << ", open=" << dispatch_output.total_open()
+            << ", elapsed time=" << elapsed << " seconds" << std::endl;
+
+  print_bar();
+
+  if (argc > 1) {
+    std::ofstream trace(argv[1]);
+    pipes::trace_write_chrome_json(trace);
+    std::cout << "trace written to " << argv[1] << std::endl;
+  }
 
   return 0;
 }
@@ -0,0 +1,249 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_trace.hpp
+//
+// Lightweight tracing of solver phases, exported in the Chrome trace_event
+// JSON format, which chrome://tracing and Perfetto can open.
+//
+// How to use:
+//
+//    pipes::trace_enable(true);
+//    ... run solvers, possibly on several threads ...
+//    std::ofstream out("trace.json");
+//    pipes::trace_write_chrome_json(out);
+//
+// Code marks a region with a trace_scope, which records one complete event
+// when it is destroyed, or splits a function into consecutive phases with
+// trace_scope::next(). While tracing is disabled a trace_scope costs one
+// relaxed atomic load. Each thread records into its own fixed-size ring
+// buffer, so recording takes no locks, and only the newest events are kept
+// when a buffer fills up. When a thread exits its ring passes, events and
+// all, to the next thread that starts recording, so there are only as many
+// rings as threads that have recorded at the same time.
+//
+// Export while other threads are still recording may see torn events, so
+// call trace_write_chrome_json() once the traced work has finished.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace pipes {
+
+namespace trace_detail {
+
+using clock = std::chrono::steady_clock;
+
+// One complete event. name must be a string literal, or otherwise outlive
+// the trace.
+struct event {
+  const char* name;
+  int64_t start_ns, duration_ns;
+};
+
+// The events recorded by one thread.
+struct ring {
+
+  static constexpr size_t CAPACITY = 1 << 16;
+
+  unsigned thread_id;
+  std::vector<event> events;
+  // Total events ever recorded; the newest is at (count - 1) % CAPACITY.
+  std::atomic<uint64_t> count{0};
+
+  ring(unsigned id) : thread_id(id), events(CAPACITY) { }
+
+  void record(const event& e) {
+    uint64_t n = count.load(std::memory_order_relaxed);
+    events[n % CAPACITY] = e;
+    count.store(n + 1, std::memory_order_release);
+  }
+};
+
+// Process-wide tracing state. Rings are kept alive here after their thread
+// exits, so their events can still be exported, and are listed in idle
+// until another thread takes them over.
+struct registry {
+  std::atomic<bool> enabled{false};
+  clock::time_point epoch = clock::now();
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ring>> rings;
+  std::vector<ring*> idle;
+
+  static registry& instance() {
+    static registry r;
+    return r;
+  }
+
+  int64_t now_ns() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      clock::now() - epoch).count();
+  }
+};
+
+// The ring a thread records into, which it hands back to the registry
+// when the thread exits.
+struct ring_owner {
+  ring* mine = nullptr;
+
+  ~ring_owner() {
+    if (mine) {
+      auto& r = registry::instance();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      r.idle.push_back(mine);
+    }
+  }
+};
+
+// Return this thread's ring, taking over an idle one or registering a new
+// one on first use.
+ring& this_thread_ring() {
+  thread_local ring_owner owner;
+  if (!owner.mine) {
+    auto& r = registry::instance();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (!r.idle.empty()) {
+      owner.mine = r.idle.back();
+      r.idle.pop_back();
+    } else {
+      r.rings.push_back(
+        std::make_unique<ring>(unsigned(r.rings.size()) + 1));
+      owner.mine = r.rings.back().get();
+    }
+  }
+  return *owner.mine;
+}
+
+// Write s as a JSON string literal.
+void write_json_string(std::ostream& out, const char* s) {
+  out << '"';
+  for (; *s; ++s) {
+    if ((*s == '"') || (*s == '\\')) {
+      out << '\\' << *s;
+    } else if (static_cast<unsigned char>(*s) < 0x20) {
+      out << ' ';
+    } else {
+      out << *s;
+    }
+  }
+  out << '"';
+}
+
+}
+
+// Turn recording on or off for all threads.
+void trace_enable(bool enabled) {
+  trace_detail::registry::instance().enabled.store(enabled);
+}
+
+// Return true if recording is on.
+bool trace_enabled() {
+  return trace_detail::registry::instance().enabled.load(
+    std::memory_order_relaxed);
+}
+
+// Discard every recorded event.
+void trace_clear() {
+  auto& r = trace_detail::registry::instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (auto& ring : r.rings) {
+    ring->count.store(0);
+  }
+}
+
+// Records the time from construction, or from the last call to next(), to
+// destruction as one event on the current thread.
+class trace_scope {
+private:
+  const char* name_;
+  int64_t start_ns_;
+
+  void finish() {
+    if (name_) {
+      auto& r = trace_detail::registry::instance();
+      trace_detail::this_thread_ring().record(
+        trace_detail::event{name_, start_ns_, r.now_ns() - start_ns_});
+    }
+  }
+
+public:
+
+  // name must be a string literal, or otherwise outlive the trace.
+  trace_scope(const char* name)
+  : name_(nullptr), start_ns_(0) {
+    next(name);
+  }
+
+  ~trace_scope() { finish(); }
+
+  trace_scope(const trace_scope&) = delete;
+  trace_scope& operator=(const trace_scope&) = delete;
+
+  // End the current event and start another one named name.
+  void next(const char* name) {
+    finish();
+    if (trace_enabled()) {
+      name_ = name;
+      start_ns_ = trace_detail::registry::instance().now_ns();
+    } else {
+      name_ = nullptr;
+    }
+  }
+};
+
+// Write every recorded event as a Chrome trace_event JSON document, one
+// complete ("X") event per trace_scope, with one track per thread.
+void trace_write_chrome_json(std::ostream& out) {
+  using namespace trace_detail;
+
+  auto& r = registry::instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  auto separate = [&]() {
+    if (!first) {
+      out << ',';
+    }
+    first = false;
+    out << '\n';
+  };
+
+  auto flags = out.flags();
+  auto precision = out.precision();
+  out.setf(std::ios::fixed);
+  out.precision(3);
+
+  for (auto& ring : r.rings) {
+    separate();
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << ring->thread_id << ",\"args\":{\"name\":\"thread "
+        << ring->thread_id << "\"}}";
+
+    uint64_t count = ring->count.load(std::memory_order_acquire);
+    uint64_t begin = (count > ring::CAPACITY) ? count - ring::CAPACITY : 0;
+    for (uint64_t i = begin; i < count; ++i) {
+      const auto& e = ring->events[i % ring::CAPACITY];
+      separate();
+      out << "{\"name\":";
+      write_json_string(out, e.name);
+      // trace_event timestamps are in microseconds.
+      out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->thread_id
+          << ",\"ts\":" << (e.start_ns / 1000.0)
+          << ",\"dur\":" << (e.duration_ns / 1000.0) << '}';
+    }
+  }
+  out << "\n]}\n";
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}
@@ -19,11 +19,32 @@
 // TODO
 #include <optional>
 
+#include "pipes_trace.hpp"
+
 namespace pipes {
 
 // Type for a row or column number.
 using coordinate = size_t;
 
+// Type for the row and column of one cell.
+struct grid_position {
+
+  coordinate row, column;
+
+  grid_position(coordinate r, coordinate c)
+  : row(r), column(c) { }
+
+  // Order by row, then column. This is the order a row-by-row scan visits
+  // cells in.
+  bool operator<(const grid_position& o) const {
+    return (row < o.row) || ((row == o.row) && (column < o.column));
+  }
+
+  bool operator==(const grid_position& o) const {
+    return (row == o.row) && (column == o.column);
+  }
+};
+
 // Type for one element of the map grid.
 enum cell_kind { CELL_SOIL, CELL_ROCK, CELL_OPEN };
 
@@ -117,6 +138,8 @@ public:
     assert(columns > 0);
     assert((open_count + rock_count) < (rows * columns));
 
+    trace_scope trace("grid: random");
+
     // The output grid, at this point all cells are earth.
     grid result(rows, columns);
 
@@ -227,17 +250,21 @@ class path {
 private:
   const grid* setting_;
   std::vector<step> steps_;
+  coordinate start_row_, start_column_;
   coordinate final_row_, final_column_;
   unsigned total_open_;
 
-  // Helper function to initialize all data members, called by the two
+  // Helper function to initialize all data members, called by the
   // constructors below.
-  void initialize(const grid& setting) {
+  void initialize(const grid& setting,
+                  coordinate start_row = 0, coordinate start_column = 0) {
     assert(steps_.empty());
+    assert(setting.may_step(start_row, start_column));
     setting_ = &setting;
     steps_.emplace_back(STEP_DIRECTION_START);
-    final_row_ = final_column_ = 0;
-    total_open_ = 0;
+    start_row_ = final_row_ = start_row;
+    start_column_ = final_column_ = start_column;
+    total_open_ = (setting.get(start_row, start_column) == CELL_OPEN) ? 1 : 0;
   }
 
 public:
@@ -259,9 +286,25 @@ public:
     }
   }
 
+  // Create a path that starts at the given cell instead of (0, 0), followed
+  // by the steps in steps_after_start, which must all be valid. The start
+  // cell must not be CELL_ROCK, and counts towards total_open() if it is
+  // CELL_OPEN.
+  path(const grid& setting,
+       coordinate start_row, coordinate start_column,
+       const std::vector<step_direction>& steps_after_start = {}) {
+    initialize(setting, start_row, start_column);
+    for (auto& step : steps_after_start) {
+      assert(is_step_valid(step));
+      add_step(step);
+    }
+  }
+
   // Accessors.
   const grid& setting() const { return *setting_; }
   const std::vector<step>& steps() const { return steps_; }
+  coordinate start_row() const { return start_row_; }
+  coordinate start_column() const { return start_column_; }
   coordinate final_row() const { return final_row_; }
   coordinate final_column() const { return final_column_; }
   unsigned total_open() const { return total_open_; }
@@ -309,7 +352,7 @@ public:
 
     auto lines = setting_->printable();
 
-    coordinate row = 0, column = 0;
+    coordinate row = start_row_, column = start_column_;
     for (auto& s : steps_) {
 
       row += s.delta_row();
@@ -340,9 +383,24 @@ public:
 
   // Equality operator, for unit testing.
   bool operator==(const path& o) const {
-    return std::equal(steps_.begin(), steps_.end(), o.steps_.begin());
+    return (start_row_ == o.start_row_) &&
+           (start_column_ == o.start_column_) &&
+           std::equal(steps_.begin(), steps_.end(), o.steps_.begin());
   }
 
 };
 
+// A solution stored as plain steps, for solvers that work on grid
+// representations too large, or too different, to build a path on: the
+// steps after STEP_DIRECTION_START of a path from (0, 0), along with where
+// it ends and how many open cells it visits.
+struct solution_steps {
+  std::vector<step_direction> steps;
+  coordinate final_row = 0, final_column = 0;
+  unsigned total_open = 0;
+
+  // Build the path on a dense grid with the same cells as the one solved.
+  path to_path(const grid& setting) const { return path(setting, steps); }
+};
+
 }
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+// pipes_workspace.hpp
+//
+// A dynamic programming solver that keeps its scratch buffers between
+// solves, for long-running processes that solve many grids in a row.
+//
+// Instead of a table of whole paths, it keeps one row of open-cell scores
+// and one byte per cell recording whether the best path arrived from the
+// left, then walks those back to recover the path. After the first few
+// solves the buffers are large enough and no further allocation happens.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "pipes_trace.hpp"
+#include "pipes_types.hpp"
+
+namespace pipes {
+
+class dyn_prog_workspace {
+private:
+  std::vector<int32_t> row_;
+  std::vector<uint8_t> from_left_;
+  solution_steps solution_;
+
+public:
+
+  // Solve a grid of the given size whose cells are given by
+  // cell_at(row, column). The result is identical to econ_pipes_dyn_prog,
+  // including how ties are broken, and stays valid until the next solve.
+  template <typename CellAt>
+  const solution_steps& solve(coordinate rows, coordinate columns,
+                              CellAt&& cell_at) {
+
+    assert(rows > 0);
+    assert(columns > 0);
+
+    trace_scope phase("workspace: fill");
+
+    row_.assign(columns, -1);
+    row_[0] = 0;
+    from_left_.assign(rows * columns, 0);
+
+    // Keep the last best cell in row-major order.
+    int32_t best = -1;
+    coordinate best_row = 0, best_column = 0;
+
+    for (coordinate r = 0; r < rows; ++r) {
+      uint8_t* bits = &from_left_[r * columns];
+      int32_t left = -1;
+      for (coordinate c = 0; c < columns; ++c) {
+        auto cell = cell_at(r, c);
+        if (cell == CELL_ROCK) {
+          row_[c] = left = -1;
+          continue;
+        }
+        int32_t score = row_[c];
+        if (left > score) {
+          score = left;
+          bits[c] = 1;
+        }
+        row_[c] = left =
+          (score < 0) ? -1 : score + ((cell == CELL_OPEN) ? 1 : 0);
+        if ((row_[c] >= 0) && (row_[c] >= best)) {
+          best = row_[c];
+          best_row = r;
+          best_column = c;
+        }
+      }
+    }
+    assert(best >= 0);
+
+    phase.next("workspace: reconstruct path");
+
+    solution_.final_row = best_row;
+    solution_.final_column = best_column;
+    solution_.total_open = unsigned(best);
+    solution_.steps.clear();
+    for (coordinate r = best_row, c = best_column; (r > 0) || (c > 0); ) {
+      if (from_left_[r * columns + c]) {
+        solution_.steps.push_back(STEP_DIRECTION_RIGHT);
+        --c;
+      } else {
+        solution_.steps.push_back(STEP_DIRECTION_DOWN);
+        --r;
+      }
+    }
+    std::reverse(solution_.steps.begin(), solution_.steps.end());
+    return solution_;
+  }
+
+  const solution_steps& solve(const grid& setting) {
+    return solve(setting.rows(), setting.columns(),
+                 [&](coordinate r, coordinate c) { return setting.get(r, c); });
+  }
+
+  // Bytes of scratch space currently held.
+  size_t capacity_bytes() const {
+    return row_.capacity() * sizeof(int32_t) + from_left_.capacity() +
+           solution_.steps.capacity() * sizeof(step_direction);
+  }
+};
+
+}